@@ -0,0 +1,32 @@
+#include "app_events.h"
+
+#include <esp_log.h>
+#include <freertos/task.h>
+
+static const char *TAG = "events";
+
+static EventGroupHandle_t s_events;
+
+int app_events_initialize(void) {
+  if (s_events != NULL) return 0;
+  s_events = xEventGroupCreate();
+  if (s_events == NULL) {
+    ESP_LOGE(TAG, "Could not create event group");
+    return 1;
+  }
+  return 0;
+}
+
+void app_events_post(EventBits_t events) {
+  if (s_events != NULL) xEventGroupSetBits(s_events, events);
+}
+
+EventBits_t app_events_wait(EventBits_t events, TickType_t timeout) {
+  if (s_events == NULL) {
+    vTaskDelay(timeout);
+    return 0;
+  }
+  EventBits_t bits =
+      xEventGroupWaitBits(s_events, events, pdTRUE, pdFALSE, timeout);
+  return bits & events;
+}
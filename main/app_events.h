@@ -0,0 +1,48 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Events passed between the gfx, network and main tasks. Consumers block on
+// the ones they care about instead of polling shared state.
+#define APP_EVENT_IMAGE_LOADED BIT0    // gfx took a queued image
+#define APP_EVENT_ANIMATION_DONE BIT1  // gfx finished a dwell (isAnimating 0)
+#define APP_EVENT_WIFI_UP BIT2         // Station got an IP address
+#define APP_EVENT_TOUCH BIT3           // Touch events queued for main
+#define APP_EVENT_CONFIG_CHANGED BIT4  // Settings were changed and saved
+#define APP_EVENT_PUSH_STATE BIT5      // WebSocket/SSE (dis)connected
+#define APP_EVENT_PUSH_IMAGE BIT6      // SSE announced an image to fetch
+#define APP_EVENT_SETTINGS_DIRTY BIT7  // Pushed settings are ready to save
+
+/**
+ * @brief Create the event bus
+ *
+ * Must be called before any other task starts posting.
+ *
+ * @return int 0 on success
+ */
+int app_events_initialize(void);
+
+/**
+ * @brief Signal one or more APP_EVENT_* bits
+ */
+void app_events_post(EventBits_t events);
+
+/**
+ * @brief Block until any of events is posted or timeout expires
+ *
+ * The bits that were returned are cleared, so each post wakes one wait. A
+ * post that happened before the call still counts, so callers should check
+ * their condition and wait in a loop.
+ *
+ * @return EventBits_t The subset of events that were posted (0 on timeout)
+ */
+EventBits_t app_events_wait(EventBits_t events, TickType_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
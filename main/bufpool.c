@@ -0,0 +1,103 @@
+#include "bufpool.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <stdlib.h>
+
+#include "sdkconfig.h"
+
+static const char *TAG = "bufpool";
+
+// Enough for one image downloading, one queued and one on screen
+#define BUFPOOL_MAX_BUFFERS 3
+// Never reserve more than this share of the free PSRAM
+#define BUFPOOL_PSRAM_SHARE 2
+
+static void *_bufs[BUFPOOL_MAX_BUFFERS];
+static bool _in_use[BUFPOOL_MAX_BUFFERS];
+static int _count;
+static portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+int bufpool_initialize(void) {
+  size_t free_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  int count = free_psram / BUFPOOL_PSRAM_SHARE / CONFIG_HTTP_BUFFER_SIZE_MAX;
+  if (count > BUFPOOL_MAX_BUFFERS) count = BUFPOOL_MAX_BUFFERS;
+
+  for (_count = 0; _count < count; _count++) {
+    _bufs[_count] =
+        heap_caps_malloc(CONFIG_HTTP_BUFFER_SIZE_MAX, MALLOC_CAP_SPIRAM);
+    if (_bufs[_count] == NULL) break;
+  }
+
+  ESP_LOGI(TAG, "%d image buffer(s) of %d bytes reserved (%zu PSRAM free)",
+           _count, CONFIG_HTTP_BUFFER_SIZE_MAX, free_psram);
+  return 0;
+}
+
+void *bufpool_acquire(size_t *size) {
+  void *buf = NULL;
+  portENTER_CRITICAL(&_lock);
+  for (int i = 0; i < _count; i++) {
+    if (!_in_use[i]) {
+      _in_use[i] = true;
+      buf = _bufs[i];
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  if (buf != NULL) {
+    *size = CONFIG_HTTP_BUFFER_SIZE_MAX;
+  } else if (_count > 0) {
+    ESP_LOGW(TAG, "All image buffers in use");
+  }
+  return buf;
+}
+
+void bufpool_release(void *buf) {
+  if (buf == NULL) return;
+
+  portENTER_CRITICAL(&_lock);
+  for (int i = 0; i < _count; i++) {
+    if (_bufs[i] == buf) {
+      _in_use[i] = false;
+      portEXIT_CRITICAL(&_lock);
+      return;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  free(buf);
+}
+
+int bufpool_credits(int slots, size_t *credit_bytes) {
+  int pool_free = 0;
+  portENTER_CRITICAL(&_lock);
+  for (int i = 0; i < _count; i++) {
+    if (!_in_use[i]) pool_free++;
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  int credits;
+  if (pool_free > 0) {
+    *credit_bytes = CONFIG_HTTP_BUFFER_SIZE_MAX;
+    credits = pool_free;
+  } else {
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    *credit_bytes = largest < CONFIG_HTTP_BUFFER_SIZE_MAX
+                        ? largest
+                        : CONFIG_HTTP_BUFFER_SIZE_MAX;
+    credits = *credit_bytes > 0
+                  ? heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / *credit_bytes
+                  : 0;
+  }
+  return credits < slots ? credits : slots;
+}
+
+bool bufpool_owns(const void *buf) {
+  for (int i = 0; i < _count; i++) {
+    if (_bufs[i] == buf) return true;
+  }
+  return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Reserve the image buffer pool
+ *
+ * Allocates a few CONFIG_HTTP_BUFFER_SIZE_MAX byte buffers from PSRAM once, so
+ * downloads can be received in place and handed to gfx without reallocating.
+ * The count is derived from the free PSRAM; without PSRAM the pool is empty
+ * and callers fall back to the heap.
+ *
+ * @return int 0 on success (also when the pool is empty)
+ */
+int bufpool_initialize(void);
+
+/**
+ * @brief Take a free pool buffer
+ *
+ * @param size Set to the buffer size when one is returned
+ * @return Buffer of CONFIG_HTTP_BUFFER_SIZE_MAX bytes, or NULL if all are in
+ *         use
+ */
+void *bufpool_acquire(size_t *size);
+
+/**
+ * @brief Give an image buffer back
+ *
+ * Returns pool buffers to the pool and frees any other heap buffer, so every
+ * image buffer can be released the same way regardless of where it came
+ * from. NULL is ignored.
+ */
+void bufpool_release(void *buf);
+
+/**
+ * @brief Push credits the device can honour right now
+ *
+ * Advertised to push servers so they don't start transfers that cannot fit.
+ * While pool buffers are free each one is a credit of
+ * CONFIG_HTTP_BUFFER_SIZE_MAX bytes; otherwise credits are sized by the
+ * largest free PSRAM block and there are as many as the free PSRAM holds.
+ *
+ * @param slots Free queue slots, the most credits there can be
+ * @param credit_bytes Set to the largest image each credit may carry
+ * @return int Number of credits, images of credit_bytes that fit at once
+ */
+int bufpool_credits(int slots, size_t *credit_bytes);
+
+/**
+ * @brief Check whether buf is a pool buffer
+ */
+bool bufpool_owns(const void *buf);
+
+#ifdef __cplusplus
+}
+#endif
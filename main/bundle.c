@@ -0,0 +1,214 @@
+#include "bundle.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bufpool.h"
+#include "display.h"
+#include "gfx.h"
+
+static const char *TAG = "bundle";
+
+#define BUNDLE_HEADER_LEN 8
+#define BUNDLE_ENTRY_HEADER_LEN 24
+#define BUNDLE_APP_ID_LEN 16
+#define BUNDLE_BRIGHTNESS_UNCHANGED 0xFF
+// Queued entries whose options are applied once gfx shows them
+#define BUNDLE_INFLIGHT_SLOTS 8
+
+struct bundle_entry {
+  uint8_t *buf;
+  size_t len;
+  int32_t dwell_secs;
+  uint8_t brightness;
+  uint8_t flags;
+  char app_id[BUNDLE_APP_ID_LEN + 1];
+};
+
+struct bundle_inflight {
+  int counter;  // gfx image counter, 0 if the slot is free
+  uint8_t brightness;
+  char app_id[BUNDLE_APP_ID_LEN + 1];
+};
+
+// Guards the held entries and the in-flight table. Taken before the gfx
+// mutex, never while holding it.
+static SemaphoreHandle_t _mutex;
+static struct bundle_entry _held[BUNDLE_MAX_ENTRIES];
+static int _held_count;
+static struct bundle_inflight _inflight[BUNDLE_INFLIGHT_SLOTS];
+static int _inflight_next;
+
+static void on_image_loaded(int counter);
+
+int bundle_initialize(void) {
+  _mutex = xSemaphoreCreateMutex();
+  if (_mutex == NULL) {
+    ESP_LOGE(TAG, "Could not create bundle mutex");
+    return 1;
+  }
+  gfx_set_loaded_callback(on_image_loaded);
+  return 0;
+}
+
+static uint32_t read_le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+bool bundle_is_bundle(const uint8_t *buf, size_t len) {
+  return buf != NULL && len >= BUNDLE_HEADER_LEN &&
+         memcmp(buf, BUNDLE_MAGIC, strlen(BUNDLE_MAGIC)) == 0;
+}
+
+// Checks that every entry lies within the bundle before anything is copied.
+static bool entries_valid(const uint8_t *buf, size_t len, int count) {
+  size_t offset = BUNDLE_HEADER_LEN;
+  for (int i = 0; i < count; i++) {
+    if (len - offset < BUNDLE_ENTRY_HEADER_LEN) return false;
+    uint32_t entry_len = read_le32(buf + offset);
+    offset += BUNDLE_ENTRY_HEADER_LEN;
+    if (entry_len == 0 || entry_len > len - offset) return false;
+    offset += entry_len;
+  }
+  return true;
+}
+
+// Hands an entry to gfx, remembering its options for when it is shown. An
+// entry only interrupts the display while its bundle is being unpacked; one
+// that had to be held joins the queue like any other. Called with _mutex
+// held.
+static void queue_entry(struct bundle_entry *entry, bool unpacking) {
+  gfx_priority_t priority = GFX_PRIORITY_NORMAL;
+  if (unpacking && (entry->flags & BUNDLE_FLAG_IMMEDIATE)) {
+    priority = GFX_PRIORITY_IMMEDIATE;
+  } else if (entry->flags & BUNDLE_FLAG_BACKGROUND) {
+    priority = GFX_PRIORITY_BACKGROUND;
+  }
+
+  int counter =
+      gfx_enqueue(entry->buf, entry->len, entry->dwell_secs, priority, 0);
+  if (counter <= 0) return;
+
+  struct bundle_inflight *slot = &_inflight[_inflight_next];
+  _inflight_next = (_inflight_next + 1) % BUNDLE_INFLIGHT_SLOTS;
+  slot->counter = counter;
+  slot->brightness = entry->brightness;
+  strlcpy(slot->app_id, entry->app_id, sizeof(slot->app_id));
+}
+
+// Moves held entries into the gfx queue while it has room. Called with
+// _mutex held.
+static void feed_gfx(bool unpacking) {
+  int used, capacity;
+  gfx_get_queue_occupancy(&used, &capacity);
+  while (_held_count > 0 && used < capacity) {
+    queue_entry(&_held[0], unpacking);
+    _held_count--;
+    memmove(&_held[0], &_held[1], _held_count * sizeof(_held[0]));
+    used++;
+  }
+}
+
+// gfx took an image from its queue: apply that entry's options and top the
+// queue up from the held entries.
+static void on_image_loaded(int counter) {
+  if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) return;
+
+  for (int i = 0; i < BUNDLE_INFLIGHT_SLOTS; i++) {
+    struct bundle_inflight *slot = &_inflight[i];
+    if (slot->counter != counter) continue;
+    ESP_LOGI(TAG, "Showing bundled app %s (counter %d)",
+             slot->app_id[0] != '\0' ? slot->app_id : "(unnamed)", counter);
+    if (slot->brightness != BUNDLE_BRIGHTNESS_UNCHANGED) {
+      display_set_brightness(slot->brightness);
+    }
+    slot->counter = 0;
+    break;
+  }
+  feed_gfx(false);
+
+  xSemaphoreGive(_mutex);
+}
+
+// Called with _mutex held.
+static void discard_held(void) {
+  for (int i = 0; i < _held_count; i++) bufpool_release(_held[i].buf);
+  _held_count = 0;
+}
+
+void bundle_discard_held(void) {
+  if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) return;
+  if (_held_count > 0) {
+    ESP_LOGI(TAG, "Dropping %d held image(s) of the previous rotation",
+             _held_count);
+    discard_held();
+  }
+  xSemaphoreGive(_mutex);
+}
+
+int bundle_unpack(uint8_t *buf, size_t len, int32_t default_dwell_secs,
+                  int32_t *total_dwell_secs) {
+  if (total_dwell_secs != NULL) *total_dwell_secs = 0;
+
+  int count = bundle_is_bundle(buf, len) ? buf[4] : 0;
+  if (count == 0 || count > BUNDLE_MAX_ENTRIES ||
+      !entries_valid(buf, len, count)) {
+    ESP_LOGE(TAG, "Malformed bundle (%zu bytes, %d entries)", len, count);
+    bufpool_release(buf);
+    return 1;
+  }
+
+  if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) {
+    bufpool_release(buf);
+    return 1;
+  }
+
+  // The new rotation replaces whatever was left of the previous one
+  discard_held();
+
+  int32_t total_secs = 0;
+  const uint8_t *p = buf + BUNDLE_HEADER_LEN;
+  for (int i = 0; i < count; i++) {
+    struct bundle_entry *entry = &_held[_held_count];
+    entry->len = read_le32(p);
+    uint16_t dwell_secs = read_le16(p + 4);
+    entry->dwell_secs = dwell_secs > 0 ? dwell_secs : default_dwell_secs;
+    entry->brightness = p[6];
+    entry->flags = p[7];
+    memcpy(entry->app_id, p + 8, BUNDLE_APP_ID_LEN);
+    entry->app_id[BUNDLE_APP_ID_LEN] = '\0';
+    const uint8_t *webp = p + BUNDLE_ENTRY_HEADER_LEN;
+    p = webp + entry->len;
+
+    // Each image needs a buffer of its own, since gfx releases them one by
+    // one
+    entry->buf = heap_caps_malloc(entry->len, MALLOC_CAP_SPIRAM);
+    if (entry->buf == NULL) {
+      ESP_LOGE(TAG, "Failed to allocate memory (%zu bytes) for %s", entry->len,
+               entry->app_id);
+      continue;
+    }
+    memcpy(entry->buf, webp, entry->len);
+    total_secs += entry->dwell_secs;
+    _held_count++;
+  }
+  int unpacked = _held_count;
+  feed_gfx(true);
+  int held = _held_count;
+
+  xSemaphoreGive(_mutex);
+  bufpool_release(buf);
+
+  ESP_LOGI(TAG,
+           "Unpacked %d image(s), %d held for later, %" PRId32 " s rotation",
+           unpacked, held, total_secs);
+  if (total_dwell_secs != NULL) *total_dwell_secs = total_secs;
+  return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bundle container: several images with their display options in one
+ * transfer (HTTP body or WebSocket/SSE/MQTT image). All integers are little
+ * endian.
+ *
+ *   Header (8 bytes):  "TBB1", uint8 count, 3 reserved bytes
+ *   Entry (24 bytes):  uint32 len, uint16 dwell_secs (0 = device default),
+ *                      uint8 brightness (0-100, 0xFF = unchanged),
+ *                      uint8 flags (BUNDLE_FLAG_*),
+ *                      char app_id[16] (NUL padded)
+ *   followed by len bytes of WebP, then the next entry.
+ */
+#define BUNDLE_MAGIC "TBB1"
+#define BUNDLE_MAX_ENTRIES 16
+#define BUNDLE_FLAG_IMMEDIATE 0x01   // Interrupt whatever is showing on arrival
+#define BUNDLE_FLAG_BACKGROUND 0x02  // Only play when nothing else waits
+
+/**
+ * @brief Set up the bundle scheduler
+ *
+ * Must be called after gfx_initialize(); hooks into gfx to feed held
+ * entries and apply their options as they are shown.
+ *
+ * @return int 0 on success
+ */
+int bundle_initialize(void);
+
+/**
+ * @brief Check whether buf holds a bundle rather than a single WebP
+ */
+bool bundle_is_bundle(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Unpack a bundle and schedule its images in order
+ *
+ * Entries are copied into their own PSRAM buffers. As many as fit go to the
+ * gfx queue right away; the rest are held and queued one by one as gfx takes
+ * images, so a whole rotation can be delivered at once. A new bundle replaces
+ * the held entries of the previous one. Takes ownership of buf, which is
+ * released whether or not it was valid.
+ *
+ * @param default_dwell_secs Dwell for entries that don't set one
+ * @param total_dwell_secs Set to the sum of the entries' dwells (may be NULL)
+ * @return int 0 on success, 1 if the bundle was malformed
+ */
+int bundle_unpack(uint8_t *buf, size_t len, int32_t default_dwell_secs,
+                  int32_t *total_dwell_secs);
+
+/**
+ * @brief Drop the held entries of the current rotation
+ *
+ * Called when a single image replaces the rotation, so the rest of it isn't
+ * fed in behind that image.
+ */
+void bundle_discard_held(void);
+
+#ifdef __cplusplus
+}
+#endif
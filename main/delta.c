@@ -0,0 +1,82 @@
+#include "delta.h"
+
+#include <esp_log.h>
+#include <string.h>
+#include <webp/decode.h>
+
+static const char *TAG = "delta";
+
+#define DELTA_HEADER_LEN 12
+#define DELTA_REGION_HEADER_LEN 8
+
+struct delta_region {
+  int x, y, w, h;
+  const uint8_t *webp;
+  size_t len;
+};
+
+static uint32_t read_le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+bool delta_is_delta(const uint8_t *buf, size_t len) {
+  return buf != NULL && len >= DELTA_HEADER_LEN &&
+         memcmp(buf, DELTA_MAGIC, strlen(DELTA_MAGIC)) == 0;
+}
+
+uint32_t delta_base_hash(const uint8_t *buf) { return read_le32(buf + 4); }
+
+// Locates every region and checks that it lies within the delta and, once
+// its WebP header gives its size, within the frame. Returns the count, or -1.
+static int regions_parse(const uint8_t *buf, size_t len, int width, int height,
+                         struct delta_region *regions) {
+  int count = buf[8];
+  if (count > DELTA_MAX_REGIONS) return -1;
+
+  size_t offset = DELTA_HEADER_LEN;
+  for (int i = 0; i < count; i++) {
+    struct delta_region *r = &regions[i];
+    if (len - offset < DELTA_REGION_HEADER_LEN) return -1;
+    r->x = read_le16(buf + offset);
+    r->y = read_le16(buf + offset + 2);
+    r->len = read_le32(buf + offset + 4);
+    offset += DELTA_REGION_HEADER_LEN;
+    if (r->len == 0 || r->len > len - offset) return -1;
+    r->webp = buf + offset;
+    offset += r->len;
+
+    if (!WebPGetInfo(r->webp, r->len, &r->w, &r->h) || r->x + r->w > width ||
+        r->y + r->h > height) {
+      return -1;
+    }
+  }
+  return count;
+}
+
+int delta_apply(const uint8_t *buf, size_t len, uint8_t *pix, int width,
+                int height) {
+  struct delta_region regions[DELTA_MAX_REGIONS];
+  int count = regions_parse(buf, len, width, height, regions);
+  if (count < 0) {
+    ESP_LOGE(TAG, "Malformed delta or region outside the %dx%d frame", width,
+             height);
+    return 1;
+  }
+
+  size_t stride = (size_t)width * 4;
+  for (int i = 0; i < count; i++) {
+    struct delta_region *r = &regions[i];
+    // Decoded straight into the frame: the stride skips the pixels on either
+    // side of the region
+    uint8_t *out = pix + r->y * stride + (size_t)r->x * 4;
+    size_t out_size = (r->h - 1) * stride + (size_t)r->w * 4;
+    if (WebPDecodeRGBAInto(r->webp, r->len, out, out_size, stride) == NULL) {
+      ESP_LOGE(TAG, "Could not decode region %d (%dx%d at %d,%d)", i, r->w,
+               r->h, r->x, r->y);
+      return 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Delta update: the regions of a static image that changed, drawn over the
+ * frame on screen so a clock or ticker doesn't resend the whole image. Sent
+ * wherever an image can be (HTTP body or WebSocket/SSE/MQTT image). All
+ * integers are little endian.
+ *
+ *   Header (12 bytes):  "TBD1", uint32 base_hash, uint8 count,
+ *                       3 reserved bytes
+ *   Region (8 bytes):   uint16 x, uint16 y (canvas position),
+ *                       uint32 len
+ *   followed by len bytes of static WebP, then the next region.
+ *
+ * An image's content hash is the CRC32 (as in zlib) of the bytes it arrived
+ * as, for a delta those of the delta itself. A delta only applies if
+ * base_hash names what is on screen; the result then takes the delta's hash,
+ * so updates chain.
+ */
+#define DELTA_MAGIC "TBD1"
+#define DELTA_MAX_REGIONS 32
+
+/**
+ * @brief Check whether buf holds a delta rather than a full image
+ */
+bool delta_is_delta(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Get the content hash a delta applies to
+ */
+uint32_t delta_base_hash(const uint8_t *buf);
+
+/**
+ * @brief Draw the regions of a delta into an RGBA frame
+ *
+ * Every region is checked against the frame before any is drawn, so a
+ * malformed delta leaves the frame untouched. Regions replace the pixels
+ * under them, alpha included.
+ *
+ * @param pix Frame of width x height RGBA pixels
+ * @return int 0 on success, 1 if the delta is malformed or doesn't fit,
+ *         2 if a region failed to decode after others were drawn
+ */
+int delta_apply(const uint8_t *buf, size_t len, uint8_t *pix, int width,
+                int height);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,14 @@
 #include "display.h"
 
 #include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
+
+#include <utility>
 
 #include "font5x7.h"
 #include "nvs_settings.h"
@@ -162,10 +170,136 @@
 #define HEIGHT 32
 #endif
 
+// Lower bound for the panel scan rate requested from the DMA driver. One
+// period at this rate is the longest a single refresh can take, so it is how
+// long a freshly flipped-away buffer may still be read by the DMA engine.
+#define DISPLAY_MIN_REFRESH_HZ 60
+
 static MatrixPanel_I2S_DMA *_matrix;
 static uint8_t _brightness = DISPLAY_DEFAULT_BRIGHTNESS;
 static const char *TAG = "display";
 
+// RGB888 canvas holding WIDTH * HEIGHT pixels in logical orientation
+// (_lw x _lh, swapped for 90/270 degree mounts). Every writer draws here; only
+// display_frame_commit() maps it onto the panel, writes the DMA back buffer
+// and flips.
+static uint8_t *_canvas;
+static int _lw = WIDTH;
+static int _lh = HEIGHT;
+static uint8_t _rotation;  // clockwise quarter turns
+static bool _mirror;
+static SemaphoreHandle_t _frame_mutex;
+static int64_t _last_flip_us;
+// One panel refresh; updated from the rate the driver resolved in begin()
+static int64_t _scanout_us = 1000000 / DISPLAY_MIN_REFRESH_HZ;
+
+struct overlay_sprite {
+  bool active;
+  int16_t x, y, w, h;
+  uint8_t r, g, b;
+};
+
+// Sprites are written from any task, so they are guarded by a spinlock
+// rather than the frame mutex, which can be held for a whole scan-out.
+static overlay_sprite _overlay[DISPLAY_OVERLAY_COUNT];
+static bool _overlay_dirty;
+static portMUX_TYPE _overlay_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline void canvas_put(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+  uint8_t *p = &_canvas[(y * _lw + x) * 3];
+  p[0] = r;
+  p[1] = g;
+  p[2] = b;
+}
+
+// Canvas pixel index shown at panel position (px, py).
+static int canvas_index(int px, int py) {
+  int lx, ly;
+  switch (_rotation) {
+    case 1:
+      lx = py;
+      ly = WIDTH - 1 - px;
+      break;
+    case 2:
+      lx = WIDTH - 1 - px;
+      ly = HEIGHT - 1 - py;
+      break;
+    case 3:
+      lx = HEIGHT - 1 - py;
+      ly = px;
+      break;
+    default:
+      lx = px;
+      ly = py;
+      break;
+  }
+  if (_mirror) lx = _lw - 1 - lx;
+  return ly * _lw + lx;
+}
+
+// Panel position of canvas pixel (lx, ly); the inverse of canvas_index().
+static void panel_coords(int lx, int ly, int *px, int *py) {
+  if (_mirror) lx = _lw - 1 - lx;
+  switch (_rotation) {
+    case 1:
+      *px = WIDTH - 1 - ly;
+      *py = lx;
+      break;
+    case 2:
+      *px = WIDTH - 1 - lx;
+      *py = HEIGHT - 1 - ly;
+      break;
+    case 3:
+      *px = ly;
+      *py = HEIGHT - 1 - lx;
+      break;
+    default:
+      *px = lx;
+      *py = ly;
+      break;
+  }
+}
+
+// Tile edge for the transposing push. 8x8 RGB888 pixels keep the canvas
+// reads of one tile within a handful of cache lines when the canvas had to
+// fall back to PSRAM.
+#define PUSH_BLOCK 8
+
+// Converts the canvas into the DMA back buffer in a single pass, applying
+// rotation and mirroring on the way. The orientation is affine, so the
+// canvas offset only needs a per-column and per-row step.
+static void push_canvas(void) {
+  const int origin = canvas_index(0, 0);
+  const int step_x = canvas_index(1, 0) - origin;
+  const int step_y = canvas_index(0, 1) - origin;
+
+  if (step_x == 1 || step_x == -1) {
+    // Panel rows are canvas rows: stream straight through.
+    for (int y = 0; y < HEIGHT; y++) {
+      int idx = origin + y * step_y;
+      for (int x = 0; x < WIDTH; x++, idx += step_x) {
+        const uint8_t *p = &_canvas[idx * 3];
+        _matrix->drawPixelRGB888(x, y, p[0], p[1], p[2]);
+      }
+    }
+    return;
+  }
+
+  // 90/270 degrees: panel rows are canvas columns. Walk in tiles so neither
+  // side strides across the whole buffer for every pixel.
+  for (int ty = 0; ty < HEIGHT; ty += PUSH_BLOCK) {
+    for (int tx = 0; tx < WIDTH; tx += PUSH_BLOCK) {
+      for (int y = ty; y < ty + PUSH_BLOCK; y++) {
+        int idx = origin + y * step_y + tx * step_x;
+        for (int x = tx; x < tx + PUSH_BLOCK; x++, idx += step_x) {
+          const uint8_t *p = &_canvas[idx * 3];
+          _matrix->drawPixelRGB888(x, y, p[0], p[1], p[2]);
+        }
+      }
+    }
+  }
+}
+
 int display_initialize(void) {
   // Get swap_colors setting
   bool swap_colors = nvs_get_swap_colors();
@@ -201,6 +335,24 @@ int display_initialize(void) {
   bool invert_clock_phase = true;
 #endif
 
+  _frame_mutex = xSemaphoreCreateRecursiveMutex();
+  if (_frame_mutex == NULL) {
+    ESP_LOGE(TAG, "Could not create frame mutex");
+    return 1;
+  }
+
+  // The canvas is only read once per commit, so PSRAM is fast enough and
+  // leaves internal RAM to the DMA buffers and WiFi/TLS
+  _canvas = (uint8_t *)heap_caps_calloc(1, WIDTH * HEIGHT * 3,
+                                        MALLOC_CAP_SPIRAM);
+  if (_canvas == NULL) {
+    _canvas = (uint8_t *)calloc(1, WIDTH * HEIGHT * 3);
+  }
+  if (_canvas == NULL) {
+    ESP_LOGE(TAG, "Could not allocate %d byte canvas", WIDTH * HEIGHT * 3);
+    return 1;
+  }
+
   HUB75_I2S_CFG mxconfig(WIDTH,                   // width
                          HEIGHT,                  // height
                          1,                       // chain length
@@ -212,16 +364,39 @@ int display_initialize(void) {
                          1,                       // latch blanking
                          invert_clock_phase       // invert clock phase
   );
+  mxconfig.min_refresh_rate = DISPLAY_MIN_REFRESH_HZ;
 
   _matrix = new MatrixPanel_I2S_DMA(mxconfig);
 
+  size_t internal_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  size_t spiram_before = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
   if (!_matrix->begin()) {
     ESP_LOGE(TAG, "MatrixPanel_I2S_DMA begin() failed");
     delete _matrix;
     _matrix = NULL;
     return 1;
   }
+  // With CONFIG_HUB75_PSRAM_DMA_BUFFER the bitplanes move to PSRAM, so the
+  // internal figure is what that option gives back to WiFi and TLS.
+  ESP_LOGI(TAG,
+           "DMA buffers: %zu bytes internal, %zu bytes PSRAM%s; refresh %d Hz",
+           internal_before - heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+           spiram_before - heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+#if CONFIG_HUB75_PSRAM_DMA_BUFFER
+           " (PSRAM DMA)",
+#else
+           "",
+#endif
+           _matrix->calculated_refresh_rate);
+  if (_matrix->calculated_refresh_rate > 0) {
+    _scanout_us = 1000000 / _matrix->calculated_refresh_rate;
+  }
+  if (_matrix->calculated_refresh_rate < DISPLAY_MIN_REFRESH_HZ) {
+    ESP_LOGW(TAG, "Refresh rate below the %d Hz target",
+             DISPLAY_MIN_REFRESH_HZ);
+  }
   display_set_brightness(DISPLAY_DEFAULT_BRIGHTNESS);
+  display_set_orientation(nvs_get_rotation() / 90, nvs_get_mirror());
 
   return 0;
 }
@@ -247,30 +422,137 @@ void display_set_brightness(uint8_t brightness_pct) {
 
     ESP_LOGI(TAG, "Setting brightness to %d%% (%d)", brightness_pct,
              brightness_8bit);
+    xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
     _matrix->setBrightness8(brightness_8bit);
     _matrix->clearScreen();
+    xSemaphoreGiveRecursive(_frame_mutex);
     _brightness = brightness_pct;
   }
 }
 
 void display_shutdown(void) {
+  xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
   _matrix->clearScreen();
   _matrix->stopDMAoutput();
   delete _matrix;
   _matrix = NULL;
+  xSemaphoreGiveRecursive(_frame_mutex);
 }
 
-void display_draw(const uint8_t *pix, int width, int height, int channels,
-                  int ixR, int ixG, int ixB) {
+// Moves the canvas content to the current logical size: what still fits
+// keeps its logical position, the rest is cleared. Rows are moved in place,
+// front to back when the stride shrinks and back to front when it grows, so
+// no row is overwritten before it has been moved.
+static void canvas_reshape(int old_w, int old_h) {
+  if (old_w == _lw && old_h == _lh) return;
+  int copy_w = old_w < _lw ? old_w : _lw;
+  int copy_h = old_h < _lh ? old_h : _lh;
+  if (_lw < old_w) {
+    for (int y = 0; y < copy_h; y++) {
+      memmove(&_canvas[y * _lw * 3], &_canvas[y * old_w * 3], copy_w * 3);
+    }
+  } else {
+    for (int y = copy_h - 1; y >= 0; y--) {
+      memmove(&_canvas[y * _lw * 3], &_canvas[y * old_w * 3], copy_w * 3);
+      memset(&_canvas[(y * _lw + copy_w) * 3], 0, (_lw - copy_w) * 3);
+    }
+  }
+  memset(&_canvas[copy_h * _lw * 3], 0, (_lh - copy_h) * _lw * 3);
+}
+
+void display_set_orientation(uint8_t rotation, bool mirror) {
+  rotation &= 3;
+  xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
+  if (rotation != _rotation || mirror != _mirror) {
+    ESP_LOGI(TAG, "Orientation: rotation %d degrees%s", rotation * 90,
+             mirror ? ", mirrored" : "");
+    int old_w = _lw;
+    int old_h = _lh;
+    _rotation = rotation;
+    _mirror = mirror;
+    _lw = (rotation & 1) ? HEIGHT : WIDTH;
+    _lh = (rotation & 1) ? WIDTH : HEIGHT;
+    // The frame on screen stays up, turned, until the next one is drawn;
+    // a static image would otherwise be blank for the rest of its dwell
+    canvas_reshape(old_w, old_h);
+    // Sprites are placed for the old geometry
+    taskENTER_CRITICAL(&_overlay_lock);
+    memset(_overlay, 0, sizeof(_overlay));
+    _overlay_dirty = true;
+    taskEXIT_CRITICAL(&_overlay_lock);
+  }
+  xSemaphoreGiveRecursive(_frame_mutex);
+}
+
+void display_frame_begin(void) {
+  xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
+}
+
+void display_frame_commit(void) {
+  if (_matrix != NULL) {
+    // flipDMABuffer() only relinks the DMA descriptors; the engine finishes
+    // the refresh in progress from the old front buffer first. Do not touch
+    // that buffer (our new back buffer) until a full scan-out has elapsed.
+    int64_t wait_us = _last_flip_us + _scanout_us - esp_timer_get_time();
+    if (wait_us > 0) {
+      vTaskDelay(pdMS_TO_TICKS((wait_us + 999) / 1000));
+    }
+
+    overlay_sprite overlay[DISPLAY_OVERLAY_COUNT];
+    taskENTER_CRITICAL(&_overlay_lock);
+    memcpy(overlay, _overlay, sizeof(overlay));
+    _overlay_dirty = false;
+    taskEXIT_CRITICAL(&_overlay_lock);
+
+    push_canvas();
+    for (int i = 0; i < DISPLAY_OVERLAY_COUNT; i++) {
+      const overlay_sprite *o = &overlay[i];
+      if (!o->active) continue;
+      // Sprites are in canvas coordinates; a rectangle stays a rectangle
+      // under rotation and mirroring, so mapping two corners is enough.
+      int x0, y0, x1, y1;
+      panel_coords(o->x, o->y, &x0, &y0);
+      panel_coords(o->x + o->w - 1, o->y + o->h - 1, &x1, &y1);
+      if (x0 > x1) std::swap(x0, x1);
+      if (y0 > y1) std::swap(y0, y1);
+      for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+          _matrix->drawPixelRGB888(x, y, o->r, o->g, o->b);
+        }
+      }
+    }
+    _matrix->flipDMABuffer();
+    _last_flip_us = esp_timer_get_time();
+  }
+  xSemaphoreGiveRecursive(_frame_mutex);
+}
+
+void display_get_size(int *width, int *height) {
+  *width = _lw;
+  *height = _lh;
+}
+
+void display_draw_region(const uint8_t *pix, int width, int height,
+                         int channels, int ixR, int ixG, int ixB, int x, int y,
+                         int w, int h) {
+  // Keep the region on the canvas
+  if (x < 0 || y < 0 || x >= _lw || y >= _lh) return;
+  if (x + w > _lw) w = _lw - x;
+  if (y + h > _lh) h = _lh - y;
+
   int scale = 1;
 #if CONFIG_BOARD_TRONBYT_S3_WIDE || CONFIG_BOARD_MATRIXPORTAL_S3_WIDE
-  if (width == 64 && height == 32) {
-    scale = 2;  // Scale up to 128x64
+  if (width * 2 == w && height * 2 == h) {
+    scale = 2;  // Scale 64x32 (or 32x64 when rotated) up to the full panel
   }
 #endif
+  // The library clipped out-of-range pixels for us; the canvas does not.
+  int draw_w = width * scale > w ? w / scale : width;
+  int draw_h = height * scale > h ? h / scale : height;
 
-  for (unsigned int i = 0; i < height; i++) {
-    for (unsigned int j = 0; j < width; j++) {
+  xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
+  for (int i = 0; i < draw_h; i++) {
+    for (int j = 0; j < draw_w; j++) {
       const uint8_t *p = &pix[(i * width + j) * channels];
       uint8_t r = p[ixR];
       uint8_t g = p[ixG];
@@ -279,34 +561,120 @@ void display_draw(const uint8_t *pix, int width, int height, int channels,
       // Draw each pixel scaled up (2x2 pixels for each original pixel)
       for (int sy = 0; sy < scale; sy++) {
         for (int sx = 0; sx < scale; sx++) {
-          _matrix->drawPixelRGB888(j * scale + sx, i * scale + sy, r, g, b);
+          canvas_put(x + j * scale + sx, y + i * scale + sy, r, g, b);
         }
       }
     }
   }
-  _matrix->flipDMABuffer();
+  xSemaphoreGiveRecursive(_frame_mutex);
 }
 
-void display_clear(void) { _matrix->clearScreen(); }
+void display_draw(const uint8_t *pix, int width, int height, int channels,
+                  int ixR, int ixG, int ixB) {
+  display_frame_begin();
+  display_draw_region(pix, width, height, channels, ixR, ixG, ixB, 0, 0, _lw,
+                      _lh);
+  display_frame_commit();
+}
 
-void display_draw_pixel(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
-  if (_matrix != NULL) {
-    _matrix->drawPixelRGB888(x, y, r, g, b);
-    _matrix->flipDMABuffer();
+void display_clear(void) {
+  xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
+  memset(_canvas, 0, WIDTH * HEIGHT * 3);
+  xSemaphoreGiveRecursive(_frame_mutex);
+}
+
+void display_overlay_set(display_overlay_t id, int x, int y, int w, int h,
+                         uint8_t r, uint8_t g, uint8_t b) {
+  if (id >= DISPLAY_OVERLAY_COUNT) return;
+  // Clip once here so the commit loop can draw without bounds checks.
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > _lw) w = _lw - x;
+  if (y + h > _lh) h = _lh - y;
+  if (w <= 0 || h <= 0) {
+    display_overlay_clear(id);
+    return;
+  }
+
+  overlay_sprite next = {true,
+                         (int16_t)x,
+                         (int16_t)y,
+                         (int16_t)w,
+                         (int16_t)h,
+                         r,
+                         g,
+                         b};
+  taskENTER_CRITICAL(&_overlay_lock);
+  if (memcmp(&_overlay[id], &next, sizeof(next)) != 0) {
+    _overlay[id] = next;
+    _overlay_dirty = true;
   }
+  taskEXIT_CRITICAL(&_overlay_lock);
 }
 
-void draw_error_indicator_pixel(void) { display_draw_pixel(0, 0, 100, 0, 0); }
+void display_overlay_clear(display_overlay_t id) {
+  if (id >= DISPLAY_OVERLAY_COUNT) return;
+  taskENTER_CRITICAL(&_overlay_lock);
+  if (_overlay[id].active) {
+    memset(&_overlay[id], 0, sizeof(_overlay[id]));
+    _overlay_dirty = true;
+  }
+  taskEXIT_CRITICAL(&_overlay_lock);
+}
+
+bool display_overlay_refresh(void) {
+  if (!_overlay_dirty || _matrix == NULL) return false;
+  display_frame_begin();
+  display_frame_commit();
+  return true;
+}
+
+void draw_error_indicator_pixel(void) {
+  display_overlay_set(DISPLAY_OVERLAY_STATUS, 0, 0, 1, 1, 100, 0, 0);
+}
+
+void clear_error_indicator_pixel(void) {
+  display_overlay_clear(DISPLAY_OVERLAY_STATUS);
+}
+
+void display_show_wifi_bars(int bars) {
+  for (int i = 0; i < 3; i++) {
+    display_overlay_t id = (display_overlay_t)(DISPLAY_OVERLAY_WIFI_1 + i);
+    if (bars < 0) {
+      display_overlay_clear(id);
+      continue;
+    }
+    // One column each, a column apart and bottom aligned; unlit bars stay
+    // dimly visible so the count reads at a glance
+    bool lit = i < bars;
+    display_overlay_set(id, _lw - 5 + i * 2, 2 - i, 1, i + 1, lit ? 100 : 15,
+                        lit ? 60 : 15, lit ? 0 : 15);
+  }
+}
+
+void display_show_sync_marker(bool syncing) {
+  if (syncing) {
+    display_overlay_set(DISPLAY_OVERLAY_SYNC, _lw - 1, _lh - 1, 1, 1, 0, 0,
+                        100);
+  } else {
+    display_overlay_clear(DISPLAY_OVERLAY_SYNC);
+  }
+}
 
 void display_fill_rect(int x, int y, int w, int h, uint8_t r, uint8_t g,
                        uint8_t b) {
-  if (_matrix != NULL) {
-    for (int iy = y; iy < y + h; iy++) {
-      for (int ix = x; ix < x + w; ix++) {
-        _matrix->drawPixelRGB888(ix, iy, r, g, b);
+  if (_matrix == NULL) {
+    return;
+  }
+  xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
+  for (int iy = y; iy < y + h; iy++) {
+    for (int ix = x; ix < x + w; ix++) {
+      if (ix >= 0 && ix < _lw && iy >= 0 && iy < _lh) {
+        canvas_put(ix, iy, r, g, b);
       }
     }
   }
+  xSemaphoreGiveRecursive(_frame_mutex);
 }
 
 void display_text(const char *text, int x, int y, uint8_t r, uint8_t g,
@@ -315,6 +683,7 @@ void display_text(const char *text, int x, int y, uint8_t r, uint8_t g,
     return;
   }
 
+  xSemaphoreTakeRecursive(_frame_mutex, portMAX_DELAY);
   int cursor_x = x;
   int cursor_y = y;
 
@@ -345,8 +714,8 @@ void display_text(const char *text, int x, int y, uint8_t r, uint8_t g,
               int py = cursor_y + (row * scale) + sy;
 
               // Check bounds
-              if (px >= 0 && px < WIDTH && py >= 0 && py < HEIGHT) {
-                _matrix->drawPixelRGB888(px, py, r, g, b);
+              if (px >= 0 && px < _lw && py >= 0 && py < _lh) {
+                canvas_put(px, py, r, g, b);
               }
             }
           }
@@ -357,12 +726,5 @@ void display_text(const char *text, int x, int y, uint8_t r, uint8_t g,
     // Move cursor to next character position (5 pixels + 1 pixel spacing)
     cursor_x += (FONT5X7_CHAR_WIDTH + 1) * scale;
   }
-
-  // Note: Not flipping buffer here anymore - caller must call display_flip()
-}
-
-void display_flip(void) {
-  if (_matrix != NULL) {
-    _matrix->flipDMABuffer();
-  }
+  xSemaphoreGiveRecursive(_frame_mutex);
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -16,15 +17,66 @@ void display_shutdown(void);
 
 void display_draw(const uint8_t* pix, int width, int height, int channels,
                   int ixR, int ixG, int ixB);
+// Like display_draw() but into a canvas region and without committing, so
+// several regions can be updated and shown with one flip.
+void display_draw_region(const uint8_t* pix, int width, int height,
+                         int channels, int ixR, int ixG, int ixB, int x, int y,
+                         int w, int h);
+// Canvas size in the current orientation.
+void display_get_size(int* width, int* height);
 
+// Orientation applied when the canvas is pushed to the panel. rotation is in
+// clockwise quarter turns (0-3), mirror flips the content horizontally
+// first. For 90/270 the canvas becomes HEIGHT x WIDTH, so servers send one
+// portrait rendition and the panel shows it upright. The canvas keeps what
+// still fits the new size, so the current frame is shown turned right away;
+// overlay sprites are cleared.
+void display_set_orientation(uint8_t rotation, bool mirror);
+
+// Frame commit API. All drawing goes into a panel-sized canvas; writers
+// bracket it with display_frame_begin()/display_frame_commit(). Begin
+// serializes writers across tasks, commit waits until the DMA engine has
+// finished scanning out the back buffer, pushes the canvas and flips.
+void display_frame_begin(void);
+void display_frame_commit(void);
+
+// Canvas primitives. Call between display_frame_begin() and
+// display_frame_commit(); nothing reaches the panel until the commit.
 void display_clear(void);
-void display_draw_pixel(int x, int y, uint8_t r, uint8_t g, uint8_t b);
 void display_fill_rect(int x, int y, int w, int h, uint8_t r, uint8_t g,
                        uint8_t b);
-void draw_error_indicator_pixel(void);
 void display_text(const char* text, int x, int y, uint8_t r, uint8_t g,
                   uint8_t b, int scale);
-void display_flip(void);
+
+// Status overlay. A small fixed list of solid-colour sprites composited on
+// top of the canvas by every commit. Changing a sprite never flips the
+// panel; the gfx task shows it with its next frame or, while idle, through
+// display_overlay_refresh().
+typedef enum {
+  DISPLAY_OVERLAY_STATUS = 0,  // Error indicator LED
+  DISPLAY_OVERLAY_OTA_TRACK,   // OTA progress bar background
+  DISPLAY_OVERLAY_OTA_BAR,     // OTA progress bar fill
+  DISPLAY_OVERLAY_WIFI_1,      // WiFi signal bars, shortest first
+  DISPLAY_OVERLAY_WIFI_2,
+  DISPLAY_OVERLAY_WIFI_3,
+  DISPLAY_OVERLAY_SYNC,  // Marker while an image is being fetched
+  DISPLAY_OVERLAY_COUNT
+} display_overlay_t;
+
+void display_overlay_set(display_overlay_t id, int x, int y, int w, int h,
+                         uint8_t r, uint8_t g, uint8_t b);
+void display_overlay_clear(display_overlay_t id);
+// Recomposites the last frame if the overlay changed since the last commit.
+// Returns true if a frame was committed.
+bool display_overlay_refresh(void);
+
+void draw_error_indicator_pixel(void);
+void clear_error_indicator_pixel(void);
+// Three signal bars in the top right corner with bars (0-3) of them lit;
+// a negative count hides them.
+void display_show_wifi_bars(int bars);
+// Pixel in the bottom right corner while the device syncs an image.
+void display_show_sync_marker(bool syncing);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,333 @@
+#include "flatjson.h"
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLATJSON_NUMBER_MAX 32
+// Deepest nesting skipped inside a member value
+#define FLATJSON_NESTING_MAX 16
+
+enum {
+  STRING_OK,
+  STRING_MALFORMED,
+  STRING_TOO_LONG,  // Consumed, but didn't fit in the scratch buffer
+};
+
+struct cursor {
+  const char *p;
+  const char *end;
+};
+
+static void skip_ws(struct cursor *c) {
+  while (c->p < c->end &&
+         (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) {
+    c->p++;
+  }
+}
+
+static int hex4(const char *p, uint32_t *out) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    char ch = p[i];
+    v <<= 4;
+    if (ch >= '0' && ch <= '9') {
+      v |= ch - '0';
+    } else if (ch >= 'a' && ch <= 'f') {
+      v |= ch - 'a' + 10;
+    } else if (ch >= 'A' && ch <= 'F') {
+      v |= ch - 'A' + 10;
+    } else {
+      return 1;
+    }
+  }
+  *out = v;
+  return 0;
+}
+
+// Appends one character to out, remembering if it didn't fit.
+static void put_char(char *out, size_t cap, size_t *len, char ch) {
+  if (*len + 1 < cap) out[*len] = ch;
+  (*len)++;
+}
+
+static void put_utf8(char *out, size_t cap, size_t *len, uint32_t cp) {
+  if (cp < 0x80) {
+    put_char(out, cap, len, cp);
+  } else if (cp < 0x800) {
+    put_char(out, cap, len, 0xC0 | (cp >> 6));
+    put_char(out, cap, len, 0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    put_char(out, cap, len, 0xE0 | (cp >> 12));
+    put_char(out, cap, len, 0x80 | ((cp >> 6) & 0x3F));
+    put_char(out, cap, len, 0x80 | (cp & 0x3F));
+  } else {
+    put_char(out, cap, len, 0xF0 | (cp >> 18));
+    put_char(out, cap, len, 0x80 | ((cp >> 12) & 0x3F));
+    put_char(out, cap, len, 0x80 | ((cp >> 6) & 0x3F));
+    put_char(out, cap, len, 0x80 | (cp & 0x3F));
+  }
+}
+
+// Reads a string starting at its opening quote, unescaping it into out.
+// out may be NULL to just skip the string.
+static int parse_string(struct cursor *c, char *out, size_t cap,
+                        size_t *out_len) {
+  if (c->p >= c->end || *c->p != '"') return STRING_MALFORMED;
+  c->p++;
+
+  size_t len = 0;
+  while (c->p < c->end && *c->p != '"') {
+    char ch = *c->p++;
+    if ((unsigned char)ch < 0x20) return STRING_MALFORMED;
+    if (ch != '\\') {
+      put_char(out, cap, &len, ch);
+      continue;
+    }
+
+    if (c->p >= c->end) return STRING_MALFORMED;
+    ch = *c->p++;
+    switch (ch) {
+      case '"':
+      case '\\':
+      case '/':
+        put_char(out, cap, &len, ch);
+        break;
+      case 'b':
+        put_char(out, cap, &len, '\b');
+        break;
+      case 'f':
+        put_char(out, cap, &len, '\f');
+        break;
+      case 'n':
+        put_char(out, cap, &len, '\n');
+        break;
+      case 'r':
+        put_char(out, cap, &len, '\r');
+        break;
+      case 't':
+        put_char(out, cap, &len, '\t');
+        break;
+      case 'u': {
+        uint32_t cp;
+        if (c->end - c->p < 4 || hex4(c->p, &cp) != 0) return STRING_MALFORMED;
+        c->p += 4;
+        // Combine a surrogate pair into one code point
+        uint32_t low;
+        if (cp >= 0xD800 && cp <= 0xDBFF && c->end - c->p >= 6 &&
+            c->p[0] == '\\' && c->p[1] == 'u' && hex4(c->p + 2, &low) == 0 &&
+            low >= 0xDC00 && low <= 0xDFFF) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          c->p += 6;
+        }
+        put_utf8(out, cap, &len, cp);
+        break;
+      }
+      default:
+        return STRING_MALFORMED;
+    }
+  }
+  if (c->p >= c->end) return STRING_MALFORMED;
+  c->p++;  // Closing quote
+
+  if (out == NULL) return STRING_OK;
+  if (len >= cap) {
+    out[cap - 1] = '\0';
+    return STRING_TOO_LONG;
+  }
+  out[len] = '\0';
+  if (out_len != NULL) *out_len = len;
+  return STRING_OK;
+}
+
+// Skips an object or array starting at its opening bracket.
+static int skip_nested(struct cursor *c) {
+  char closers[FLATJSON_NESTING_MAX];
+  int depth = 0;
+  while (c->p < c->end) {
+    char ch = *c->p;
+    if (ch == '"') {
+      if (parse_string(c, NULL, 0, NULL) != STRING_OK) return 1;
+      continue;
+    }
+    c->p++;
+    if (ch == '{' || ch == '[') {
+      if (depth == FLATJSON_NESTING_MAX) return 1;
+      closers[depth++] = ch == '{' ? '}' : ']';
+    } else if (ch == '}' || ch == ']') {
+      if (depth == 0 || closers[--depth] != ch) return 1;
+      if (depth == 0) return 0;
+    }
+  }
+  return 1;
+}
+
+static int parse_number(struct cursor *c, flatjson_value_t *value) {
+  char buf[FLATJSON_NUMBER_MAX];
+  size_t len = 0;
+  // strchr() also finds the terminator, so a NUL must be ruled out first
+  while (c->p < c->end && len < sizeof(buf) - 1 && *c->p != '\0' &&
+         strchr("+-0123456789.eE", *c->p) != NULL) {
+    buf[len++] = *c->p++;
+  }
+  buf[len] = '\0';
+
+  char *end;
+  double number = strtod(buf, &end);
+  if (len == 0 || *end != '\0') return 1;
+
+  value->type = FLATJSON_NUMBER;
+  value->number = number;
+  if (number >= INT_MAX) {
+    value->integer = INT_MAX;
+  } else if (number <= INT_MIN) {
+    value->integer = INT_MIN;
+  } else {
+    value->integer = (int)number;
+  }
+  return 0;
+}
+
+static int match_literal(struct cursor *c, const char *literal) {
+  size_t len = strlen(literal);
+  if ((size_t)(c->end - c->p) < len || memcmp(c->p, literal, len) != 0) {
+    return 1;
+  }
+  c->p += len;
+  return 0;
+}
+
+int flatjson_parse(const char *json, size_t len, flatjson_cb_t cb, void *ctx) {
+  struct cursor c = {.p = json, .end = json + len};
+  char key[FLATJSON_KEY_MAX];
+  char string[FLATJSON_STRING_MAX];
+
+  skip_ws(&c);
+  if (c.p >= c.end || *c.p != '{') return 1;
+  c.p++;
+  skip_ws(&c);
+  if (c.p < c.end && *c.p == '}') return 0;
+
+  while (c.p < c.end) {
+    skip_ws(&c);
+    int key_status = parse_string(&c, key, sizeof(key), NULL);
+    if (key_status == STRING_MALFORMED) return 1;
+    skip_ws(&c);
+    if (c.p >= c.end || *c.p != ':') return 1;
+    c.p++;
+    skip_ws(&c);
+    if (c.p >= c.end) return 1;
+
+    flatjson_value_t value = {0};
+    bool report = key_status == STRING_OK;
+    char ch = *c.p;
+    if (ch == '"') {
+      int status = parse_string(&c, string, sizeof(string), &value.string_len);
+      if (status == STRING_MALFORMED) return 1;
+      if (status == STRING_TOO_LONG) report = false;
+      value.type = FLATJSON_STRING;
+      value.string = string;
+    } else if (ch == '{' || ch == '[') {
+      if (skip_nested(&c) != 0) return 1;
+      value.type = FLATJSON_NESTED;
+    } else if (ch == 't' || ch == 'f') {
+      value.type = FLATJSON_BOOL;
+      value.boolean = ch == 't';
+      if (match_literal(&c, value.boolean ? "true" : "false") != 0) return 1;
+    } else if (ch == 'n') {
+      value.type = FLATJSON_NULL;
+      if (match_literal(&c, "null") != 0) return 1;
+    } else {
+      if (parse_number(&c, &value) != 0) return 1;
+    }
+
+    if (report) cb(key, &value, ctx);
+
+    skip_ws(&c);
+    if (c.p >= c.end) return 1;
+    if (*c.p == '}') return 0;
+    if (*c.p != ',') return 1;
+    c.p++;
+  }
+  return 1;
+}
+
+void flatjson_writer_init(flatjson_writer_t *w, char *buf, size_t cap) {
+  w->buf = buf;
+  w->cap = cap;
+  w->len = 0;
+  w->need_comma = false;
+  w->overflow = cap == 0;
+  if (cap > 0) buf[0] = '\0';
+}
+
+static void append(flatjson_writer_t *w, const char *fmt, ...) {
+  if (w->overflow) return;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(w->buf + w->len, w->cap - w->len, fmt, args);
+  va_end(args);
+  if (n < 0 || (size_t)n >= w->cap - w->len) {
+    w->overflow = true;
+    return;
+  }
+  w->len += n;
+}
+
+static void append_escaped(flatjson_writer_t *w, const char *s) {
+  append(w, "\"");
+  for (; *s != '\0' && !w->overflow; s++) {
+    unsigned char ch = *s;
+    if (ch == '"' || ch == '\\') {
+      append(w, "\\%c", ch);
+    } else if (ch < 0x20) {
+      append(w, "\\u%04x", ch);
+    } else {
+      append(w, "%c", ch);
+    }
+  }
+  append(w, "\"");
+}
+
+static void begin_member(flatjson_writer_t *w, const char *key) {
+  if (w->need_comma) append(w, ",");
+  w->need_comma = true;
+  if (key != NULL) {
+    append_escaped(w, key);
+    append(w, ":");
+  }
+}
+
+void flatjson_begin_object(flatjson_writer_t *w, const char *key) {
+  begin_member(w, key);
+  append(w, "{");
+  w->need_comma = false;
+}
+
+void flatjson_end_object(flatjson_writer_t *w) {
+  append(w, "}");
+  w->need_comma = true;
+}
+
+void flatjson_add_string(flatjson_writer_t *w, const char *key,
+                         const char *value) {
+  begin_member(w, key);
+  append_escaped(w, value != NULL ? value : "");
+}
+
+void flatjson_add_int(flatjson_writer_t *w, const char *key, int value) {
+  begin_member(w, key);
+  append(w, "%d", value);
+}
+
+void flatjson_add_bool(flatjson_writer_t *w, const char *key, bool value) {
+  begin_member(w, key);
+  append(w, value ? "true" : "false");
+}
+
+int flatjson_writer_finish(flatjson_writer_t *w) {
+  return w->overflow ? -1 : (int)w->len;
+}
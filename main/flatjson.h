@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest key and decoded string value handed to a callback; longer ones
+// are skipped
+#define FLATJSON_KEY_MAX 32
+#define FLATJSON_STRING_MAX 512
+
+typedef enum {
+  FLATJSON_NULL,
+  FLATJSON_BOOL,
+  FLATJSON_NUMBER,
+  FLATJSON_STRING,
+  FLATJSON_NESTED,  // Object or array, skipped over without looking inside
+} flatjson_type_t;
+
+typedef struct {
+  flatjson_type_t type;
+  bool boolean;
+  double number;
+  int integer;         // number, truncated and clamped to the int range
+  const char *string;  // Unescaped and NUL-terminated; valid in the callback
+  size_t string_len;
+} flatjson_value_t;
+
+typedef void (*flatjson_cb_t)(const char *key, const flatjson_value_t *value,
+                              void *ctx);
+
+/**
+ * @brief Parse the top-level members of a JSON object in a single pass
+ *
+ * Calls cb for each member in order. Works directly on json (which need not
+ * be NUL-terminated) using only stack scratch space, so no heap is touched.
+ * Members before a syntax error have already been reported.
+ *
+ * @return int 0 on success, 1 if json is not a well-formed object
+ */
+int flatjson_parse(const char *json, size_t len, flatjson_cb_t cb, void *ctx);
+
+/**
+ * @brief Builds a JSON object into a fixed buffer
+ *
+ * Members are appended in order; nested objects are opened and closed
+ * explicitly. Output that doesn't fit is truncated and flagged.
+ */
+typedef struct {
+  char *buf;
+  size_t cap;
+  size_t len;
+  bool need_comma;
+  bool overflow;
+} flatjson_writer_t;
+
+void flatjson_writer_init(flatjson_writer_t *w, char *buf, size_t cap);
+// key is NULL for the outermost object
+void flatjson_begin_object(flatjson_writer_t *w, const char *key);
+void flatjson_end_object(flatjson_writer_t *w);
+void flatjson_add_string(flatjson_writer_t *w, const char *key,
+                         const char *value);
+void flatjson_add_int(flatjson_writer_t *w, const char *key, int value);
+void flatjson_add_bool(flatjson_writer_t *w, const char *key, bool value);
+// Length of the NUL-terminated output, or -1 if it was truncated
+int flatjson_writer_finish(flatjson_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
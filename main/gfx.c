@@ -1,19 +1,26 @@
 #include <esp_heap_caps.h>
 #include <esp_log.h>
+#include <esp_rom_crc.h>
 #include <esp_websocket_client.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <http_parser.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <webp/demux.h>
 
+#include "app_events.h"
 #include "assets.h"
+#include "bufpool.h"
+#include "delta.h"
 #include "display.h"
 #include "esp_timer.h"
+#include "gfx.h"
 #include "nvs_settings.h"
 #include "version.h"
+#include "wsout.h"
 
 static const char *TAG = "gfx";
 
@@ -21,25 +28,102 @@ static const char *TAG = "gfx";
 #define GFX_TASK_PRIO 2
 #define GFX_TASK_STACK_SIZE 4092
 
-struct gfx_state {
-  TaskHandle_t task;
-  SemaphoreHandle_t mutex;
+// Images waiting for the gfx task. Kept sorted by priority, FIFO within a
+// priority, and guarded by the gfx mutex like the rest of gfx_state.
+#define GFX_QUEUE_SLOTS 4
+
+struct gfx_queue_entry {
   void *buf;
   size_t len;
   int32_t dwell_secs;
+  gfx_priority_t priority;
+  int64_t expires_us;  // 0 = never
+  int counter;
+};
+
+struct gfx_state {
+  TaskHandle_t task;
+  SemaphoreHandle_t mutex;
+  struct gfx_queue_entry queue[GFX_QUEUE_SLOTS];
+  int queued;
   int counter;
   int loaded_counter;  // Counter that tracks which image has been loaded by gfx
                        // task
+  volatile int failed_counter;  // Last image that could not be decoded
   esp_websocket_client_handle_t
       ws_handle;  // Websocket handle for sending notifications
+  void (*loaded_callback)(int counter);
   volatile bool paused;
 };
 
 static struct gfx_state *_state = NULL;
 
+// Zone compositor. Zone 0 always plays the image queued through gfx_update()
+// and owns the dwell; the other zones loop whatever was last sent to them.
+// All zones share one render loop that decodes whichever zone is due next and
+// shows every zone updated in the same pass with a single frame commit.
+struct gfx_zone {
+  int x, y, w, h;
+  void *buf;  // Owned by the zone, except for zone 0 (owned by gfx_loop)
+  size_t len;
+  void *pending;  // Replacement queued by gfx_update_zone()
+  size_t pending_len;
+  WebPAnimDecoder *decoder;
+  WebPAnimInfo info;
+  int last_timestamp;
+  int64_t next_frame_us;  // INT64_MAX once a static image has been drawn
+};
+
+// Zones whose deadlines fall within this window are decoded together and
+// share a commit, so the panel is not flipped once per zone.
+#define GFX_ZONE_BATCH_US 8000
+// Floor for frames with a zero or missing duration
+#define GFX_ZONE_MIN_FRAME_MS 10
+
+static struct gfx_zone _zones[GFX_MAX_ZONES];
+static int _zone_count = 1;
+static uint8_t _zone_layout = GFX_ZONES_SINGLE;  // Last request applied
+// What is shown: single zone when the panel is too small for the request
+static uint8_t _zone_layout_effective = GFX_ZONES_SINGLE;
+static volatile uint8_t _zone_layout_requested = GFX_ZONES_SINGLE;
+static int _zone_canvas_w, _zone_canvas_h;  // Canvas the zones were laid on
+static uint32_t _zone_late_frames;
+// Every frame committed, and those of the main image drawn late because
+// decoding took longer than the previous frame's duration
+static volatile uint32_t _frames_drawn;
+static volatile uint32_t _late_frames;
+
+// Decoded frame of the static main image on screen, so it isn't decoded
+// again every dwell and delta updates can be drawn over it. Only touched
+// from the gfx task.
+struct gfx_frame {
+  uint8_t *pix;  // RGBA
+  size_t size;   // Bytes allocated
+  int width, height;
+  uint32_t hash;  // Content hash of what it shows (see delta.h)
+  bool valid;
+};
+static struct gfx_frame _frame;
+
+// Command-to-pixel measurement for gfx_preempt(): when the command came in,
+// and when it could first be acted on (the later of the command and the
+// arrival of the image it was for). 0 while nothing is pending.
+static volatile int64_t _preempt_us;
+static volatile int64_t _preempt_ready_us;
+static int64_t _preempt_latency_us;
+// How long a preempted gfx task waits for the image the preemption was for
+// (an HTTP fetch after a tap, or a pushed image) before it resumes the one it
+// interrupted. The HTTP fetch timeout, so a failed fetch has given up by then.
+#define GFX_PREEMPT_WAIT_US (20 * 1000000LL)
+
 static void gfx_loop(void *arg);
 static int draw_webp(const uint8_t *buf, size_t len, int32_t dwell_secs,
                      volatile int32_t *isAnimating);
+static int draw_zones(const uint8_t *buf, size_t len, int32_t dwell_secs,
+                      volatile int32_t *isAnimating);
+static void draw_frame(int32_t dwell_secs, volatile int32_t *isAnimating);
+static int frame_apply_delta(const uint8_t *buf, size_t len, int counter);
+static void zones_configure(uint8_t requested);
 static void send_websocket_notification(int counter);
 
 int gfx_initialize(const char *img_url) {
@@ -58,16 +142,20 @@ int gfx_initialize(const char *img_url) {
 
   _state = calloc(1, sizeof(struct gfx_state));
   _state->paused = false;
+  _zone_layout_requested = nvs_get_zone_layout();
   if (!nvs_get_skip_boot_animation()) {
-    _state->len = ASSET_BOOT_WEBP_LEN;
+    struct gfx_queue_entry *boot = &_state->queue[0];
+    boot->len = ASSET_BOOT_WEBP_LEN;
     ESP_LOGI(TAG, "calloc buff");
-    _state->buf = calloc(1, ASSET_BOOT_WEBP_LEN);
+    boot->buf = calloc(1, ASSET_BOOT_WEBP_LEN);
     ESP_LOGI(TAG, "done calloc, copying");
-    if (_state->buf == NULL) {
+    if (boot->buf == NULL) {
       ESP_LOGE("gfx", "Memory allocation failed!");
       return 1;
     }
-    memcpy(_state->buf, ASSET_BOOT_WEBP, ASSET_BOOT_WEBP_LEN);
+    memcpy(boot->buf, ASSET_BOOT_WEBP, ASSET_BOOT_WEBP_LEN);
+    boot->priority = GFX_PRIORITY_NORMAL;
+    _state->queued = 1;
     ESP_LOGI(TAG, "done, copying");
   }
 
@@ -84,12 +172,15 @@ int gfx_initialize(const char *img_url) {
   }
 
   if (nvs_get_skip_boot_animation()) {
+    display_frame_begin();
     display_clear();
+    display_frame_commit();
   }
 
   // Display version if not skipped
   if (!nvs_get_skip_display_version()) {
     // Display version and image_url for 1 second
+    display_frame_begin();
     display_clear();
     char version_text[32];
     snprintf(version_text, sizeof(version_text), "v%s", FIRMWARE_VERSION);
@@ -174,8 +265,8 @@ int gfx_initialize(const char *img_url) {
     int x = (64 - text_width) / 2;
     display_text(version_text, x, 24, 255, 255, 255, 1);
 
-    // Flip the buffer once to show all three text lines at the same time
-    display_flip();
+    // Commit once to show all three text lines at the same time
+    display_frame_commit();
 
     vTaskDelay(pdMS_TO_TICKS(2000));
   }
@@ -219,66 +310,156 @@ static void send_websocket_notification(int counter) {
     return;
   }
 
-  // Create JSON message: {"displaying": 42}
-  char message[128];
-  int len = snprintf(message, sizeof(message), "{\"displaying\":%d}", counter);
+  // Create JSON message: {"displaying": 42, "queue": 1, "credits": 1,
+  // "credit_bytes": 409600}. Called from gfx_loop with the gfx mutex held, so
+  // the occupancy is current. The server may push as many images as there
+  // are credits, each no larger than credit_bytes.
+  size_t credit_bytes;
+  int credits =
+      bufpool_credits(GFX_QUEUE_SLOTS - _state->queued, &credit_bytes);
+  char message[WSOUT_MSG_MAX];
+  int len = snprintf(message, sizeof(message),
+                     "{\"displaying\":%d,\"queue\":%d,\"credits\":%d,"
+                     "\"credit_bytes\":%zu}",
+                     counter, _state->queued, credits, credit_bytes);
 
   if (len < 0 || len >= sizeof(message)) {
     ESP_LOGE(TAG, "Failed to format websocket notification message");
     return;
   }
 
-  int sent = esp_websocket_client_send_text(_state->ws_handle, message, len,
-                                            portMAX_DELAY);
-  if (sent < 0) {
-    ESP_LOGE(TAG, "Failed to send websocket notification");
-  } else {
-    ESP_LOGI(TAG, "WS send: %s", message);
+  // Queued for the sender task, so a stalled connection can't hold up
+  // rendering; a newer one replaces it if it hasn't gone out yet
+  if (wsout_send(message, len, WSOUT_KIND_DISPLAYING) != 0) {
+    ESP_LOGW(TAG, "Could not queue websocket notification");
+  }
+}
+
+static const char *priority_name(gfx_priority_t priority) {
+  switch (priority) {
+    case GFX_PRIORITY_IMMEDIATE:
+      return "immediate";
+    case GFX_PRIORITY_BACKGROUND:
+      return "background";
+    default:
+      return "normal";
+  }
+}
+
+// Inserts entry behind everything of equal or higher priority. When the
+// queue is full the oldest lowest-priority entry makes room, unless the new
+// one ranks below all of them. Returns false if entry was not queued.
+// Called with the gfx mutex held.
+static bool queue_push(const struct gfx_queue_entry *entry) {
+  if (_state->queued == GFX_QUEUE_SLOTS) {
+    // Entries are sorted, so the victim is the first of the last priority
+    int victim = _state->queued - 1;
+    while (victim > 0 && _state->queue[victim - 1].priority ==
+                             _state->queue[victim].priority) {
+      victim--;
+    }
+    if (_state->queue[victim].priority > entry->priority) return false;
+
+    ESP_LOGW(TAG, "Queue full, dropping image counter %d",
+             _state->queue[victim].counter);
+    bufpool_release(_state->queue[victim].buf);
+    memmove(&_state->queue[victim], &_state->queue[victim + 1],
+            (_state->queued - victim - 1) * sizeof(struct gfx_queue_entry));
+    _state->queued--;
+  }
+
+  int pos = _state->queued;
+  while (pos > 0 && _state->queue[pos - 1].priority < entry->priority) pos--;
+  memmove(&_state->queue[pos + 1], &_state->queue[pos],
+          (_state->queued - pos) * sizeof(struct gfx_queue_entry));
+  _state->queue[pos] = *entry;
+  _state->queued++;
+  return true;
+}
+
+// Takes the next image that hasn't expired. Called with the gfx mutex held.
+static bool queue_pop(struct gfx_queue_entry *entry) {
+  int64_t now = esp_timer_get_time();
+  while (_state->queued > 0) {
+    *entry = _state->queue[0];
+    _state->queued--;
+    memmove(&_state->queue[0], &_state->queue[1],
+            _state->queued * sizeof(struct gfx_queue_entry));
+    if (entry->expires_us == 0 || entry->expires_us > now) return true;
+
+    ESP_LOGW(TAG, "Image counter %d expired before it was shown",
+             entry->counter);
+    bufpool_release(entry->buf);
   }
+  return false;
 }
 
 int gfx_update(void *webp, size_t len, int32_t dwell_secs) {
+  return gfx_enqueue(webp, len, dwell_secs, GFX_PRIORITY_NORMAL, 0);
+}
+
+int gfx_enqueue(void *webp, size_t len, int32_t dwell_secs,
+                gfx_priority_t priority, uint32_t ttl_secs) {
   if (pdTRUE != xSemaphoreTake(_state->mutex, portMAX_DELAY)) {
     ESP_LOGE(TAG, "Could not take gfx mutex");
     return -1;  // Return negative on error
   }
 
-  // If a new frame arrives before the previous one is consumed by the gfx task,
-  // free the old buffer here to prevent a memory leak (frame-dropping
-  // strategy).
-  if (_state->buf) {
-    ESP_LOGW(TAG,
-             "Dropping queued image (counter %d) - new image arrived before it "
-             "was displayed",
-             _state->counter);
-    free(_state->buf);
-    _state->buf = NULL;
-  }
-
   // Take ownership of new buffer (no copy)
-  _state->buf = webp;
-  _state->len = len;
-  _state->dwell_secs = dwell_secs;
-  _state->counter++;
-  int counter = _state->counter;
-  ESP_LOGI(TAG, "Queued image counter=%d size=%zu dwell=%d", counter, len,
-           dwell_secs);
+  struct gfx_queue_entry entry = {
+      .buf = webp,
+      .len = len,
+      .dwell_secs = dwell_secs,
+      .priority = priority,
+      .expires_us =
+          ttl_secs ? esp_timer_get_time() + ttl_secs * 1000000LL : 0,
+      .counter = ++_state->counter,
+  };
+  int counter = entry.counter;
+  bool queued = queue_push(&entry);
+  int used = _state->queued;
+  if (queued && priority == GFX_PRIORITY_IMMEDIATE) {
+    // Only now that the entry is at the front, and still under the mutex:
+    // gfx_loop pops (and restarts animating) under it too, so it takes this
+    // image next rather than one queued before it
+    gfx_preempt();
+  }
 
   if (pdTRUE != xSemaphoreGive(_state->mutex)) {
     ESP_LOGE(TAG, "Could not give gfx mutex");
     return -1;  // Return negative on error
   }
 
-  // Send "queued" notification immediately when image is queued
-  if (_state->ws_handle &&
+  if (!queued) {
+    ESP_LOGW(TAG, "Queue full of higher priority images, dropping counter %d",
+             counter);
+    bufpool_release(webp);
+  } else {
+    ESP_LOGI(TAG,
+             "Queued image counter=%d size=%zu dwell=%d priority=%s (%d/%d)",
+             counter, len, dwell_secs, priority_name(priority), used,
+             GFX_QUEUE_SLOTS);
+  }
+
+  // An image for a pending preemption: time from here, not from the command
+  if (_preempt_us != 0) _preempt_ready_us = esp_timer_get_time();
+  // Wake an idle or preempted gfx task right away
+  if (_state->task) xTaskNotifyGive(_state->task);
+
+  // Send "queued" notification immediately when image is queued, with the
+  // occupancy and remaining credits so the server can pace its pushes
+  if (queued && _state->ws_handle &&
       esp_websocket_client_is_connected(_state->ws_handle)) {
-    char message[64];
-    int msg_len =
-        snprintf(message, sizeof(message), "{\"queued\":%d}", counter);
+    size_t credit_bytes;
+    int credits = bufpool_credits(GFX_QUEUE_SLOTS - used, &credit_bytes);
+    char message[WSOUT_MSG_MAX];
+    int msg_len = snprintf(message, sizeof(message),
+                           "{\"queued\":%d,\"queue\":%d,\"queue_max\":%d,"
+                           "\"credits\":%d,\"credit_bytes\":%zu}",
+                           counter, used, GFX_QUEUE_SLOTS, credits,
+                           credit_bytes);
     if (msg_len > 0 && msg_len < sizeof(message)) {
-      esp_websocket_client_send_text(_state->ws_handle, message, msg_len,
-                                     portMAX_DELAY);
-      ESP_LOGI(TAG, "WS Send: %s", message);
+      wsout_send(message, msg_len, WSOUT_KIND_QUEUED);
     }
   }
 
@@ -286,6 +467,24 @@ int gfx_update(void *webp, size_t len, int32_t dwell_secs) {
                    // to be loaded
 }
 
+void gfx_get_queue_occupancy(int *used, int *capacity) {
+  *used = 0;
+  *capacity = GFX_QUEUE_SLOTS;
+  if (!_state) return;
+  if (pdTRUE != xSemaphoreTake(_state->mutex, portMAX_DELAY)) return;
+  *used = _state->queued;
+  xSemaphoreGive(_state->mutex);
+}
+
+void gfx_set_loaded_callback(void (*callback)(int counter)) {
+  if (!_state) return;
+  _state->loaded_callback = callback;
+}
+
+int gfx_get_failed_counter(void) {
+  return _state ? _state->failed_counter : 0;
+}
+
 int gfx_get_loaded_counter(void) {
   if (!_state) return -1;
 
@@ -304,6 +503,49 @@ int gfx_get_loaded_counter(void) {
   return loaded;
 }
 
+int gfx_update_zone(int zone, void *webp, size_t len) {
+  if (zone == 0) {
+    return gfx_update(webp, len, 0);
+  }
+  if (zone < 0 || zone >= GFX_MAX_ZONES) {
+    ESP_LOGE(TAG, "Invalid zone %d", zone);
+    return -1;
+  }
+
+  if (pdTRUE != xSemaphoreTake(_state->mutex, portMAX_DELAY)) {
+    ESP_LOGE(TAG, "Could not take gfx mutex");
+    return -1;
+  }
+  if (zone >= _zone_count) {
+    // Nothing would ever take it, and it would pin an image buffer
+    xSemaphoreGive(_state->mutex);
+    ESP_LOGW(TAG, "Zone %d is not in the current layout (%d zone(s))", zone,
+             _zone_count);
+    return -1;
+  }
+  // Same frame-dropping strategy as the main queue
+  if (_zones[zone].pending) {
+    ESP_LOGW(TAG, "Dropping queued image for zone %d", zone);
+    bufpool_release(_zones[zone].pending);
+  }
+  _zones[zone].pending = webp;
+  _zones[zone].pending_len = len;
+  xSemaphoreGive(_state->mutex);
+
+  ESP_LOGI(TAG, "Queued image for zone %d size=%zu", zone, len);
+  return 0;
+}
+
+void gfx_set_zone_layout(uint8_t layout) {
+  if (layout > GFX_ZONES_TICKER) {
+    ESP_LOGW(TAG, "Unknown zone layout %d", layout);
+    return;
+  }
+  // Applied by gfx_loop between images, so the zone buffers are only ever
+  // touched from the gfx task
+  _zone_layout_requested = layout;
+}
+
 int gfx_display_asset(const char *asset_type) {
   const uint8_t *asset_data = NULL;
   size_t asset_len = 0;
@@ -336,20 +578,19 @@ int gfx_display_asset(const char *asset_type) {
 
   memcpy(asset_heap_copy, asset_data, asset_len);
 
-  // Interrupt current animation to display asset immediately
-  isAnimating = -1;
-
-  // Display the asset with no dwell time (static display)
-  int result = gfx_update(asset_heap_copy, asset_len, 0);
+  // Display the asset at once with no dwell time (static display), ahead of
+  // anything already queued
+  int result = gfx_enqueue(asset_heap_copy, asset_len, 0,
+                           GFX_PRIORITY_IMMEDIATE, 0);
   if (result < 0) {
-    // Only free if gfx_update failed to take ownership (returned negative
+    // Only free if gfx_enqueue failed to take ownership (returned negative
     // error)
     ESP_LOGE(TAG, "Failed to update graphics with %s asset", asset_type);
     free(asset_heap_copy);
     return 1;
   }
 
-  // gfx_update now owns the asset_heap_copy buffer (returns counter >= 0 on
+  // gfx_enqueue now owns the asset_heap_copy buffer (returns counter >= 0 on
   // success)
   return 0;
 }
@@ -361,6 +602,45 @@ void gfx_display_text(const char *text, int x, int y, uint8_t r, uint8_t g,
 
 void gfx_shutdown(void) { display_shutdown(); }
 
+// Sleeps until wake_tick. Notifications from gfx_preempt() and gfx_update()
+// wake the task early; returns false if that was a preemption, and keeps
+// sleeping otherwise so a plain gfx_update() never shortens a frame.
+static bool gfx_wait_until(TickType_t wake_tick,
+                           volatile int32_t *isAnimating) {
+  for (;;) {
+    if (*isAnimating == -1 || _state->paused) return false;
+    TickType_t remaining = wake_tick - xTaskGetTickCount();
+    if ((int32_t)remaining <= 0) return true;
+    ulTaskNotifyTake(pdTRUE, remaining);
+  }
+}
+
+// Called after a frame is committed to close out a pending preemption.
+static void preempt_frame_shown(void) {
+  if (_preempt_us == 0) return;
+  int64_t now = esp_timer_get_time();
+  _preempt_latency_us = now - _preempt_ready_us;
+  ESP_LOGI(TAG, "Preempt to pixel: %" PRId64 " us (%" PRId64
+           " us after the command)", _preempt_latency_us, now - _preempt_us);
+  _preempt_us = 0;
+}
+
+void gfx_preempt(void) {
+  if (!_state) return;
+  int64_t now = esp_timer_get_time();
+  _preempt_us = now;
+  _preempt_ready_us = now;
+  isAnimating = -1;
+  if (_state->task) xTaskNotifyGive(_state->task);
+}
+
+int64_t gfx_get_preempt_latency_us(void) { return _preempt_latency_us; }
+
+void gfx_get_render_stats(uint32_t *frames, uint32_t *late_frames) {
+  *frames = _frames_drawn;
+  *late_frames = _late_frames + _zone_late_frames;
+}
+
 static void gfx_loop(void *args) {
   ESP_LOGI(TAG, "gfx_loop ENTERED");
   void *webp = NULL;
@@ -371,29 +651,39 @@ static void gfx_loop(void *args) {
 
   for (;;) {
     if (_state->paused) {
-      vTaskDelay(pdMS_TO_TICKS(100));
+      // Still the only task that flips for status updates, e.g. OTA progress
+      display_overlay_refresh();
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
       continue;
     }
 
     if (pdTRUE != xSemaphoreTake(_state->mutex, portMAX_DELAY)) {
       ESP_LOGE(TAG, "Could not take gfx mutex");
       if (webp) {
-        free(webp);
+        bufpool_release(webp);
         webp = NULL;
       }
       break;
     }
 
     // If there's new data, take ownership of buffer
-    if (counter != _state->counter) {
-      ESP_LOGI(TAG, "Displaying image counter=%d", _state->counter);
-      if (webp) free(webp);
-      webp = _state->buf;
-      len = _state->len;
-      dwell_secs = _state->dwell_secs;
-      _state->buf = NULL;  // gfx_loop now owns the buffer
-      counter = _state->counter;
+    struct gfx_queue_entry next;
+    bool loaded = queue_pop(&next);
+    bool delta = loaded && delta_is_delta(next.buf, next.len);
+    if (loaded) {
+      ESP_LOGI(TAG, "Displaying %s counter=%d (%d still queued)",
+               delta ? "delta" : "image", next.counter, _state->queued);
+      if (!delta) {
+        bufpool_release(webp);
+        webp = next.buf;  // gfx_loop now owns the buffer
+        len = next.len;
+        dwell_secs = next.dwell_secs;
+        _frame.valid = false;  // Until draw_webp() decodes the new image
+      }
+      counter = next.counter;
       _state->loaded_counter = counter;  // Signal that we've loaded this image
+      app_events_post(APP_EVENT_IMAGE_LOADED);
+      clear_error_indicator_pixel();
       if (isAnimating == -1 && !_state->paused) isAnimating = 1;
 
       // Send websocket notification that we're now displaying this image
@@ -402,8 +692,35 @@ static void gfx_loop(void *args) {
 
     if (pdTRUE != xSemaphoreGive(_state->mutex)) {
       ESP_LOGE(TAG, "Could not give gfx mutex");
+      if (delta) bufpool_release(next.buf);
       continue;
     }
+    if (delta) {
+      // Decoded outside the lock. If it doesn't apply, the current image
+      // simply keeps playing.
+      if (frame_apply_delta(next.buf, next.len, next.counter) == 0) {
+        bufpool_release(webp);  // Superseded by the patched frame
+        webp = NULL;
+        len = 0;
+        dwell_secs = next.dwell_secs;
+      }
+      bufpool_release(next.buf);
+    }
+    if (loaded && _state->loaded_callback) _state->loaded_callback(counter);
+
+    if (isAnimating == -1) {
+      if (_preempt_us != 0 &&
+          esp_timer_get_time() - _preempt_us < GFX_PREEMPT_WAIT_US) {
+        // Preempted, but the image it was for hasn't arrived yet: sleep until
+        // gfx_update() wakes us instead of restarting the old one
+        display_overlay_refresh();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+        continue;
+      }
+      ESP_LOGW(TAG, "No image followed the preemption, resuming the last one");
+      _preempt_us = 0;
+      isAnimating = 1;
+    }
 
     // static int stack_check_counter = 0;
     // if (++stack_check_counter >= 100) {
@@ -412,24 +729,141 @@ static void gfx_loop(void *args) {
       ESP_LOGI(TAG, "Stack remaining: %u bytes", stack_free);
     // }
 
-    if (webp && len > 0) {
+    int canvas_w, canvas_h;
+    display_get_size(&canvas_w, &canvas_h);
+    if (_zone_layout != _zone_layout_requested || canvas_w != _zone_canvas_w ||
+        canvas_h != _zone_canvas_h) {
+      zones_configure(_zone_layout_requested);
+    }
+
+    if (_zone_count > 1) {
+      // Side zones keep animating even while the main zone has nothing
+      if (draw_zones(webp, len, dwell_secs, &isAnimating)) {
+        ESP_LOGE(TAG, "Could not draw webp in main zone");
+        draw_error_indicator_pixel();
+        _state->failed_counter = counter;
+        isAnimating = 0;
+        app_events_post(APP_EVENT_ANIMATION_DONE);
+        bufpool_release(webp);
+        webp = NULL;
+        len = 0;
+      }
+    } else if (_frame.valid) {
+      draw_frame(dwell_secs, &isAnimating);
+    } else if (webp && len > 0) {
       if (draw_webp(webp, len, dwell_secs, &isAnimating)) {
         ESP_LOGE(TAG, "Could not draw webp");
         draw_error_indicator_pixel();
+        _state->failed_counter = counter;
         vTaskDelay(pdMS_TO_TICKS(1 * 1000));
         isAnimating = 0;
+        app_events_post(APP_EVENT_ANIMATION_DONE);
         // Free the invalid buffer to prevent re-drawing it
-        free(webp);
+        bufpool_release(webp);
         webp = NULL;
         len = 0;
       }
       // keep webp around to loop until the next image arrives
     } else {
-      vTaskDelay(pdMS_TO_TICKS(100));
+      display_overlay_refresh();
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
     }
   }
 }
 
+// Keeps a copy of a decoded static image for draw_frame().
+static void frame_store(const uint8_t *pix, int width, int height,
+                        uint32_t hash) {
+  size_t size = (size_t)width * height * 4;
+  if (size > _frame.size) {
+    free(_frame.pix);
+    _frame.pix = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (_frame.pix == NULL) _frame.pix = malloc(size);
+    _frame.size = _frame.pix != NULL ? size : 0;
+  }
+  if (_frame.pix == NULL) {
+    ESP_LOGW(TAG, "No memory to keep the decoded frame");
+    _frame.valid = false;
+    return;
+  }
+  memcpy(_frame.pix, pix, size);
+  _frame.width = width;
+  _frame.height = height;
+  _frame.hash = hash;
+  _frame.valid = true;
+}
+
+// Tells a push server that a delta's base is not on screen, so it sends the
+// full image instead.
+static void send_delta_miss(int counter) {
+  char message[WSOUT_MSG_MAX];
+  int len = snprintf(message, sizeof(message),
+                     "{\"delta_miss\":%d,\"hash\":\"%08" PRIx32 "\"}",
+                     counter, _frame.valid ? _frame.hash : 0);
+  if (len > 0 && len < sizeof(message)) {
+    wsout_send(message, len, WSOUT_KIND_OTHER);
+  }
+}
+
+// Draws a delta over the frame on screen. Returns 0 if it applied.
+static int frame_apply_delta(const uint8_t *buf, size_t len, int counter) {
+  uint32_t base_hash = delta_base_hash(buf);
+  if (!_frame.valid || _zone_count > 1 || base_hash != _frame.hash) {
+    ESP_LOGW(TAG,
+             "Delta counter %d is for %08" PRIx32
+             ", which is not on screen (%08" PRIx32 ")",
+             counter, base_hash, _frame.valid ? _frame.hash : 0);
+    send_delta_miss(counter);
+    return 1;
+  }
+
+  int64_t start_us = esp_timer_get_time();
+  int status =
+      delta_apply(buf, len, _frame.pix, _frame.width, _frame.height);
+  if (status != 0) {
+    // A partly drawn frame is no base for anything; the image it came from
+    // is decoded again if it is still around
+    if (status == 2) _frame.valid = false;
+    send_delta_miss(counter);
+    return 1;
+  }
+  _frame.hash = esp_rom_crc32_le(0, buf, len);
+  ESP_LOGI(TAG, "Applied delta counter %d (%zu bytes) in %" PRId64 " us",
+           counter, len, esp_timer_get_time() - start_us);
+  return 0;
+}
+
+// Holds a static frame for the dwell while keeping overlays up to date.
+static void hold_frame(int64_t dwell_us, volatile int32_t *isAnimating) {
+  // Break the dwell into 100ms chunks so we can respond to immediate
+  // commands
+  int64_t static_start_us = esp_timer_get_time();
+  while (esp_timer_get_time() - static_start_us < dwell_us) {
+    // No further frames will be drawn, so status changes land here
+    display_overlay_refresh();
+    // Check every 100ms; an immediate command wakes us straight away
+    if (!gfx_wait_until(xTaskGetTickCount() + pdMS_TO_TICKS(100),
+                        isAnimating)) {
+      break;
+    }
+  }
+}
+
+// Shows the cached frame for the dwell, like draw_webp() does a static
+// image, but without decoding anything.
+static void draw_frame(int32_t dwell_secs, volatile int32_t *isAnimating) {
+  int64_t dwell_us = dwell_secs > 0 ? dwell_secs * 1000000LL : 1000000;
+  display_draw(_frame.pix, _frame.width, _frame.height, 4, 0, 1, 2);
+  _frames_drawn++;
+  preempt_frame_shown();
+  hold_frame(dwell_us, isAnimating);
+
+  if (*isAnimating != -1) {
+    *isAnimating = 0;
+    app_events_post(APP_EVENT_ANIMATION_DONE);
+  }
+}
+
 static int draw_webp(const uint8_t *buf, size_t len, int32_t dwell_secs,
                      volatile int32_t *isAnimating) {
   // Set up WebP decoder
@@ -485,13 +919,26 @@ static int draw_webp(const uint8_t *buf, size_t len, int32_t dwell_secs,
       int timestamp;
       WebPAnimDecoderGetNext(decoder, &pix, &timestamp);
       if (delay > 0) {
-        xTaskDelayUntil(&drawStartTick, pdMS_TO_TICKS(delay));
+        if (xTaskGetTickCount() > drawStartTick + pdMS_TO_TICKS(delay)) {
+          _late_frames++;
+        }
+        if (!gfx_wait_until(drawStartTick + pdMS_TO_TICKS(delay),
+                            isAnimating)) {
+          break;
+        }
       } else {
         vTaskDelay(10);  // small delay for yield.
       }
       drawStartTick = xTaskGetTickCount();
       display_draw(pix, animation.canvas_width, animation.canvas_height, 4, 0,
                    1, 2);
+      _frames_drawn++;
+      if (animation.frame_count == 1 && !_frame.valid) {
+        // Later dwells draw the copy, and deltas can patch it
+        frame_store(pix, animation.canvas_width, animation.canvas_height,
+                    esp_rom_crc32_le(0, buf, len));
+      }
+      preempt_frame_shown();
       delay = timestamp - lastTimestamp;
       lastTimestamp = timestamp;
     }
@@ -500,7 +947,7 @@ static int draw_webp(const uint8_t *buf, size_t len, int32_t dwell_secs,
     WebPAnimDecoderReset(decoder);
 
     if (delay > 0) {
-      xTaskDelayUntil(&drawStartTick, pdMS_TO_TICKS(delay));
+      gfx_wait_until(drawStartTick + pdMS_TO_TICKS(delay), isAnimating);
     } else {
       vTaskDelay(
           pdMS_TO_TICKS(100));  // Add a small fallback delay to yield CPU
@@ -509,16 +956,8 @@ static int draw_webp(const uint8_t *buf, size_t len, int32_t dwell_secs,
     // In case of a single frame, sleep for app_dwell_secs
     if (animation.frame_count == 1) {
       // For static images, we need to check isAnimating periodically during the
-      // dwell time Break the dwell time into 100ms chunks so we can respond to
-      // immediate commands
-      int64_t static_start_us = esp_timer_get_time();
-      while (esp_timer_get_time() - static_start_us < dwell_us) {
-        if (*isAnimating == -1 || _state->paused) {
-          // Immediate command received, break out of dwell time
-          break;
-        }
-        vTaskDelay(pdMS_TO_TICKS(100));  // Check every 100ms
-      }
+      // dwell time
+      hold_frame(dwell_us, isAnimating);
       break;
     }
   }
@@ -527,14 +966,237 @@ static int draw_webp(const uint8_t *buf, size_t len, int32_t dwell_secs,
   // ESP_LOGI(TAG, "Setting isAnimating to 0");
   if (*isAnimating != -1) {
     *isAnimating = 0;
+    app_events_post(APP_EVENT_ANIMATION_DONE);
+  }
+  return 0;
+}
+
+static void zone_unload(struct gfx_zone *z, bool owns_buf) {
+  if (z->decoder) {
+    WebPAnimDecoderDelete(z->decoder);
+    z->decoder = NULL;
+  }
+  if (owns_buf && z->buf) {
+    bufpool_release(z->buf);
+  }
+  z->buf = NULL;
+  z->len = 0;
+  z->next_frame_us = INT64_MAX;
+}
+
+static int zone_load(struct gfx_zone *z, void *buf, size_t len) {
+  z->buf = buf;
+  z->len = len;
+  z->next_frame_us = INT64_MAX;
+  if (buf == NULL || len == 0) return 0;
+
+  WebPData webpData = {.bytes = buf, .size = len};
+  WebPAnimDecoderOptions decoderOptions;
+  WebPAnimDecoderOptionsInit(&decoderOptions);
+  decoderOptions.color_mode = MODE_RGBA;
+
+  z->decoder = WebPAnimDecoderNew(&webpData, &decoderOptions);
+  if (z->decoder == NULL || !WebPAnimDecoderGetInfo(z->decoder, &z->info)) {
+    ESP_LOGE(TAG, "Could not create WebP decoder for zone");
+    if (z->decoder) WebPAnimDecoderDelete(z->decoder);
+    z->decoder = NULL;
+    return 1;
+  }
+  z->last_timestamp = 0;
+  z->next_frame_us = esp_timer_get_time();  // Draw the first frame right away
+  return 0;
+}
+
+static void zones_configure(uint8_t requested) {
+  int w, h;
+  display_get_size(&w, &h);
+  _zone_canvas_w = w;
+  _zone_canvas_h = h;
+  uint8_t layout = requested;
+  if (layout != GFX_ZONES_SINGLE && (w < 128 || h < 64)) {
+    ESP_LOGW(TAG, "Zone layout %d needs a 128x64 panel, using single zone",
+             layout);
+    layout = GFX_ZONES_SINGLE;
+  }
+
+  // Only called from gfx_loop, which never holds zone 0's buffer here
+  if (pdTRUE != xSemaphoreTake(_state->mutex, portMAX_DELAY)) return;
+  bool was_split = _zone_count > 1;
+  for (int i = 0; i < GFX_MAX_ZONES; i++) {
+    zone_unload(&_zones[i], i != 0);
+    if (_zones[i].pending) {
+      bufpool_release(_zones[i].pending);
+      _zones[i].pending = NULL;
+    }
+  }
+
+  switch (layout) {
+    case GFX_ZONES_QUAD:
+      for (int i = 0; i < 4; i++) {
+        _zones[i] = (struct gfx_zone){.x = (i % 2) * (w / 2),
+                                      .y = (i / 2) * (h / 2),
+                                      .w = w / 2,
+                                      .h = h / 2,
+                                      .next_frame_us = INT64_MAX};
+      }
+      _zone_count = 4;
+      break;
+    case GFX_ZONES_TICKER:
+      _zones[0] = (struct gfx_zone){
+          .x = 0, .y = 0, .w = w, .h = h * 3 / 4, .next_frame_us = INT64_MAX};
+      _zones[1] = (struct gfx_zone){.x = 0,
+                                    .y = h * 3 / 4,
+                                    .w = w,
+                                    .h = h / 4,
+                                    .next_frame_us = INT64_MAX};
+      _zone_count = 2;
+      break;
+    default:
+      _zones[0] = (struct gfx_zone){
+          .x = 0, .y = 0, .w = w, .h = h, .next_frame_us = INT64_MAX};
+      _zone_count = 1;
+      break;
+  }
+  // Only the request that was applied: gfx_set_zone_layout() may already
+  // have asked for another one, which the next pass picks up
+  _zone_layout = requested;
+  _zone_layout_effective = layout;
+  xSemaphoreGive(_state->mutex);
+
+  ESP_LOGI(TAG, "Zone layout %d with %d zone(s)", _zone_layout_effective,
+           _zone_count);
+  if (was_split || _zone_count > 1) {
+    // Don't leave stale tiles behind
+    display_frame_begin();
+    display_clear();
+    display_frame_commit();
+  }
+}
+
+// Swap in images queued for the side zones since the last pass.
+static void zones_take_pending(void) {
+  if (pdTRUE != xSemaphoreTake(_state->mutex, portMAX_DELAY)) return;
+  for (int i = 1; i < _zone_count; i++) {
+    struct gfx_zone *z = &_zones[i];
+    if (z->pending == NULL) continue;
+    zone_unload(z, true);
+    if (zone_load(z, z->pending, z->pending_len)) {
+      draw_error_indicator_pixel();
+      bufpool_release(z->pending);
+      z->buf = NULL;
+    }
+    z->pending = NULL;
+    z->pending_len = 0;
+  }
+  xSemaphoreGive(_state->mutex);
+}
+
+// Decodes the next frame of a due zone into its region of the canvas and
+// schedules the one after it.
+static void zone_step(struct gfx_zone *z, int64_t now) {
+  if (!WebPAnimDecoderHasMoreFrames(z->decoder)) {
+    WebPAnimDecoderReset(z->decoder);
+    z->last_timestamp = 0;
+  }
+  uint8_t *pix;
+  int timestamp;
+  if (!WebPAnimDecoderGetNext(z->decoder, &pix, &timestamp)) {
+    ESP_LOGE(TAG, "Could not decode zone frame");
+    z->next_frame_us = INT64_MAX;
+    return;
+  }
+  display_draw_region(pix, z->info.canvas_width, z->info.canvas_height, 4, 0,
+                      1, 2, z->x, z->y, z->w, z->h);
+
+  if (z->info.frame_count == 1) {
+    z->next_frame_us = INT64_MAX;  // Static: nothing more until replaced
+    return;
+  }
+  int delay = timestamp - z->last_timestamp;
+  z->last_timestamp = timestamp;
+  if (delay < GFX_ZONE_MIN_FRAME_MS) delay = GFX_ZONE_MIN_FRAME_MS;
+
+  // Advance from the deadline rather than from now to keep each zone's
+  // cadence; if a zone fell a whole frame behind, skip instead of bursting.
+  z->next_frame_us += (int64_t)delay * 1000;
+  if (z->next_frame_us < now) {
+    _zone_late_frames++;
+    z->next_frame_us = now + (int64_t)delay * 1000;
+  }
+}
+
+static int draw_zones(const uint8_t *buf, size_t len, int32_t dwell_secs,
+                      volatile int32_t *isAnimating) {
+  struct gfx_zone *main_zone = &_zones[0];
+  if (zone_load(main_zone, (void *)buf, len)) {
+    zone_unload(main_zone, false);
+    return 1;
+  }
+
+  int64_t dwell_us = (dwell_secs > 0 ? dwell_secs : 1) * 1000000LL;
+  int64_t start_us = esp_timer_get_time();
+  uint32_t late_at_start = _zone_late_frames;
+
+  while (esp_timer_get_time() - start_us < dwell_us && *isAnimating != -1 &&
+         !_state->paused && _zone_layout == _zone_layout_requested) {
+    zones_take_pending();
+
+    int64_t now = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < _zone_count; i++) {
+      if (_zones[i].decoder && _zones[i].next_frame_us < next) {
+        next = _zones[i].next_frame_us;
+      }
+    }
+
+    if (next > now) {
+      // Sleep until the earliest deadline, but at most 100ms so commands,
+      // new side-zone images and overlay changes are still noticed.
+      int64_t wait_ms = next == INT64_MAX ? 100 : (next - now + 999) / 1000;
+      if (wait_ms > 100) {
+        display_overlay_refresh();
+        wait_ms = 100;
+      }
+      gfx_wait_until(xTaskGetTickCount() + pdMS_TO_TICKS(wait_ms),
+                     isAnimating);
+      continue;
+    }
+
+    display_frame_begin();
+    for (int i = 0; i < _zone_count; i++) {
+      struct gfx_zone *z = &_zones[i];
+      if (z->decoder && z->next_frame_us <= now + GFX_ZONE_BATCH_US) {
+        zone_step(z, now);
+      }
+    }
+    display_frame_commit();
+    _frames_drawn++;
+    preempt_frame_shown();
+  }
+
+  zone_unload(main_zone, false);
+  if (_zone_late_frames != late_at_start) {
+    ESP_LOGW(TAG, "Zones missed %" PRIu32 " frame deadline(s)",
+             _zone_late_frames - late_at_start);
+  }
+
+  if (buf != NULL && *isAnimating != -1) {
+    *isAnimating = 0;
+    app_events_post(APP_EVENT_ANIMATION_DONE);
   }
   return 0;
 }
 
 void gfx_stop(void) {
   if (_state) {
-    isAnimating = -1;  // Signal current draw to stop
     _state->paused = true;
+    // Signal the current draw to stop. Unlike gfx_preempt() this doesn't
+    // time the next frame, which only comes after the pause; a preemption
+    // still waiting for its frame is dropped for the same reason.
+    _preempt_us = 0;
+    isAnimating = -1;
+    if (_state->task) xTaskNotifyGive(_state->task);
+    app_events_post(APP_EVENT_ANIMATION_DONE);
     ESP_LOGI(TAG, "Graphics loop paused");
   }
 }
@@ -543,6 +1205,7 @@ void gfx_start(void) {
   if (_state) {
     isAnimating = 0;
     _state->paused = false;
+    app_events_post(APP_EVENT_ANIMATION_DONE);
     ESP_LOGI(TAG, "Graphics loop resumed");
   }
 }
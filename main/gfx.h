@@ -2,12 +2,55 @@
 
 #include <esp_websocket_client.h>
 #include <stddef.h>
+#include <stdint.h>
+
+// Zone layouts for showing several images at once on 128x64 panels
+#define GFX_MAX_ZONES 4
+#define GFX_ZONES_SINGLE 0  // One image on the whole panel
+#define GFX_ZONES_QUAD 1    // Four 64x32 tiles
+#define GFX_ZONES_TICKER 2  // 128x48 main area above a 128x16 ticker
+
+// Queue priorities. Immediate images go to the front and interrupt what is
+// showing; background images only play when nothing else is waiting.
+typedef enum {
+  GFX_PRIORITY_BACKGROUND = 0,
+  GFX_PRIORITY_NORMAL = 1,
+  GFX_PRIORITY_IMMEDIATE = 2,
+} gfx_priority_t;
 
 int gfx_initialize(const char* img_url);
 void gfx_set_websocket_handle(esp_websocket_client_handle_t ws_handle);
+// Queues webp for display and takes ownership of it; image buffers are given
+// back with bufpool_release() once gfx is done with them.
 int gfx_update(void* webp, size_t len, int32_t dwell_secs);
+// Like gfx_update() with an explicit priority and an optional time to live
+// (0 = none); images that expire while queued are dropped unseen. Returns
+// the image counter, which is never loaded if the queue was full of higher
+// priority images.
+int gfx_enqueue(void* webp, size_t len, int32_t dwell_secs,
+                gfx_priority_t priority, uint32_t ttl_secs);
+void gfx_get_queue_occupancy(int* used, int* capacity);
 int gfx_get_loaded_counter(void);
+// Counter of the last main image that failed to decode, 0 if none has.
+int gfx_get_failed_counter(void);
+// Called on the gfx task with the counter of each image it takes from the
+// queue, outside the gfx lock so the callback may queue more.
+void gfx_set_loaded_callback(void (*callback)(int counter));
+// Queues an image for a zone of the current layout. Zone 0 is the main queue
+// (same as gfx_update()); other zones loop their image until replaced. Takes
+// ownership of webp on success; zones outside the layout are refused.
+int gfx_update_zone(int zone, void* webp, size_t len);
+void gfx_set_zone_layout(uint8_t layout);
 int gfx_display_asset(const char* asset_type);
+// Interrupts the current image at once (immediate commands). Wakes the gfx
+// task out of any frame delay; it idles until the next queued image, and
+// resumes the interrupted one if none arrives within the fetch timeout.
+void gfx_preempt(void);
+// Time from the last preemption (or its image arriving, if later) to the
+// first frame of the new image.
+int64_t gfx_get_preempt_latency_us(void);
+// Frames drawn since boot, and how many of them were drawn after their time.
+void gfx_get_render_stats(uint32_t* frames, uint32_t* late_frames);
 void gfx_display_text(const char* text, int x, int y, uint8_t r, uint8_t g,
                       uint8_t b, int scale);
 void gfx_stop(void);
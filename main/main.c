@@ -1,32 +1,42 @@
-#include <cJSON.h>
 #include <ctype.h>  // For isdigit
 #include <esp_crt_bundle.h>
 #include <esp_heap_caps.h>
 #include <esp_log.h>
+#include <esp_rom_crc.h>
 #include <esp_timer.h>
 #include <esp_websocket_client.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
+#include <sys/time.h>
 #include <webp/demux.h>
 
 #include "ap.h"
+#include "app_events.h"
+#include "bufpool.h"
+#include "bundle.h"
 #include "display.h"
 #include "esp_sntp.h"
 #include "flash.h"
+#include "flatjson.h"
 #include "gfx.h"
+#include "mqtt_push.h"
 #include "nvs_settings.h"
 #include "ota.h"
 #include "remote.h"
 #include "sdkconfig.h"
 #include "sntp.h"
+#include "sse.h"
 #include "syslog.h"
+#include "telemetry.h"
 #ifdef CONFIG_BOARD_TIDBYT_GEN2
 #include "touch_control.h"
 #endif
 #include "version.h"
 #include "wifi.h"
+#include "wsframe.h"
+#include "wsout.h"
 
 #if CONFIG_BUTTON_PIN >= 0
 #include <driver/gpio.h>
@@ -34,7 +44,9 @@
 
 // Default URL if none is provided through WiFi manager
 #define DEFAULT_URL "http://URL.NOT.SET/"
-#define WEBSOCKET_PROTOCOL_VERSION 1
+// Highest WebSocket protocol offered in client_info. The server confirms
+// v2 with a protocol_version control message; until then v1 is spoken.
+#define WEBSOCKET_PROTOCOL_VERSION 2
 
 #ifndef CONFIG_REFRESH_INTERVAL_SECONDS
 #define CONFIG_REFRESH_INTERVAL_SECONDS 10
@@ -45,8 +57,9 @@ volatile int32_t isAnimating = 1;
 static int32_t app_dwell_secs = CONFIG_REFRESH_INTERVAL_SECONDS;
 // main buffer downloaded webp data
 static uint8_t* webp;
-// Flag to track oversize websocket messages
-static bool websocket_oversize_detected = false;
+// The rest of the current binary WebSocket message is skipped (oversize or
+// invalid)
+static bool ws_discard_message = false;
 
 static bool use_websocket = false;
 static esp_websocket_client_handle_t ws_handle;
@@ -54,7 +67,7 @@ static EventGroupHandle_t s_ws_event_group;
 #define WS_CONNECTED_BIT BIT0
 
 static bool button_boot = false;
-static bool first_ws_image_received = false;
+static bool first_push_image_received = false;
 static bool config_received = false;
 
 #ifdef CONFIG_BOARD_TIDBYT_GEN2
@@ -62,10 +75,27 @@ static bool config_received = false;
 static bool display_power_on = true;
 static uint8_t saved_brightness = 30;
 static void handle_touch_event(touch_event_t event);
+
+// The pad has no interrupt wired up, so it is sampled here every 50ms (fast
+// enough for gesture detection) and events are handled right away instead
+// of waiting for the main loop to come around. Sampling stops while touch is
+// disabled, which can change at run time over the push connection.
+static void touch_task(void* arg) {
+  for (;;) {
+    touch_event_t touch_event =
+        nvs_get_disable_touch() ? TOUCH_EVENT_NONE : touch_control_check();
+    if (touch_event != TOUCH_EVENT_NONE) {
+      handle_touch_event(touch_event);
+      app_events_post(APP_EVENT_TOUCH);
+    }
+    vTaskDelay(pdMS_TO_TICKS(50));
+  }
+}
 #endif
 
 static void config_saved_callback(void) {
   config_received = true;
+  app_events_post(APP_EVENT_CONFIG_CHANGED);
   ESP_LOGI(TAG, "Configuration saved - signaling main task");
 }
 
@@ -78,9 +108,35 @@ static void ota_task_entry(void* pvParameter) {
 
 // Globals for WebSocket reassembly
 static size_t ws_accumulated_len = 0;
+static size_t ws_buf_size = 0;  // Capacity of the reassembly buffer
+// Start of the binary message being received, for its receive time
+static int64_t ws_message_start_us = 0;
+// Protocol the server confirmed for this connection
+static int ws_protocol_version = 1;
+// v2 header of the binary message being reassembled (header_len 0 for a v1
+// message) and the CRC of its payload so far
+static wsframe_header_t ws_frame;
+static uint32_t ws_frame_crc = 0;
+// The v2 header as it arrives; it may be split across data events
+static uint8_t ws_header_buf[WSFRAME_HEADER_LEN + WSFRAME_TIMESTAMP_LEN];
+static size_t ws_header_got = 0;
+static bool ws_header_pending = false;
+// Zone and queue options for the next pushed image (WebSocket binary
+// message, SSE image event or MQTT image topic). Control messages set them on
+// the transport's task, but SSE images are queued from the main task, so
+// they are guarded by a spinlock.
+struct push_options {
+  int zone;
+  gfx_priority_t priority;
+  uint32_t ttl_secs;
+};
+static struct push_options next_push = {0, GFX_PRIORITY_NORMAL, 0};
+static portMUX_TYPE next_push_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Room for every client_info field at its maximum length
+#define CLIENT_INFO_MAX_LEN 1024
 
 static esp_err_t send_client_info(void) {
-  esp_err_t ret = ESP_OK;
   uint8_t mac[6];
   char ssid[33] = {0};
   char hostname[33] = {0};
@@ -93,61 +149,583 @@ static esp_err_t send_client_info(void) {
   const char* image_url = nvs_get_image_url();
   if (image_url == NULL) image_url = "";
 
-  cJSON* root = cJSON_CreateObject();
-  if (root) {
-    cJSON* ci = cJSON_AddObjectToObject(root, "client_info");
-    if (ci) {
-      cJSON_AddStringToObject(ci, "firmware_version", FIRMWARE_VERSION);
-      cJSON_AddStringToObject(ci, "firmware_type", "ESP32");
-      cJSON_AddNumberToObject(ci, "protocol_version",
-                              WEBSOCKET_PROTOCOL_VERSION);
-
-      if (wifi_get_mac(mac) == 0) {
-        char mac_str[18];
-        snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
-                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-        cJSON_AddStringToObject(ci, "mac", mac_str);
-      } else {
-        ESP_LOGW(TAG,
-                 "Failed to get MAC address; sending client info without MAC.");
-      }
+  char json[CLIENT_INFO_MAX_LEN];
+  flatjson_writer_t w;
+  flatjson_writer_init(&w, json, sizeof(json));
+  flatjson_begin_object(&w, NULL);
+  flatjson_begin_object(&w, "client_info");
+  flatjson_add_string(&w, "firmware_version", FIRMWARE_VERSION);
+  flatjson_add_string(&w, "firmware_type", "ESP32");
+  flatjson_add_int(&w, "protocol_version", WEBSOCKET_PROTOCOL_VERSION);
+
+  if (wifi_get_mac(mac) == 0) {
+    char mac_str[18];
+    snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0],
+             mac[1], mac[2], mac[3], mac[4], mac[5]);
+    flatjson_add_string(&w, "mac", mac_str);
+  } else {
+    ESP_LOGW(TAG,
+             "Failed to get MAC address; sending client info without MAC.");
+  }
 
-      cJSON_AddStringToObject(ci, "ssid", ssid);
-      cJSON_AddStringToObject(ci, "hostname", hostname);
-      cJSON_AddStringToObject(ci, "syslog_addr", syslog_addr);
-      cJSON_AddStringToObject(ci, "sntp_server", sntp_server);
-      cJSON_AddStringToObject(ci, "image_url", image_url);
-      cJSON_AddBoolToObject(ci, "swap_colors", nvs_get_swap_colors());
-      cJSON_AddNumberToObject(ci, "wifi_power_save", nvs_get_wifi_power_save());
-      cJSON_AddBoolToObject(ci, "skip_display_version",
-                            nvs_get_skip_display_version());
-      cJSON_AddBoolToObject(ci, "skip_boot_animation",
-                            nvs_get_skip_boot_animation());
-      cJSON_AddBoolToObject(ci, "ap_mode", nvs_get_ap_mode());
-      cJSON_AddBoolToObject(ci, "prefer_ipv6", nvs_get_prefer_ipv6());
-      cJSON_AddBoolToObject(ci, "disable_touch", nvs_get_disable_touch());
-
-      char* json_str = cJSON_PrintUnformatted(root);
-      if (json_str) {
-        ESP_LOGI(TAG, "Sending client info: %s", json_str);
-        int sent = esp_websocket_client_send_text(
-            ws_handle, json_str, strlen(json_str), portMAX_DELAY);
-        if (sent < 0) {
-          ESP_LOGE(TAG, "Failed to send client info: %d", sent);
-          ret = ESP_FAIL;
-        }
-        free(json_str);
-      } else {
-        ret = ESP_ERR_NO_MEM;
-      }
-    } else {
-      ret = ESP_FAIL;  // Failed to add object
+  flatjson_add_string(&w, "ssid", ssid);
+  flatjson_add_string(&w, "hostname", hostname);
+  flatjson_add_string(&w, "syslog_addr", syslog_addr);
+  flatjson_add_string(&w, "sntp_server", sntp_server);
+  flatjson_add_string(&w, "image_url", image_url);
+  flatjson_add_bool(&w, "swap_colors", nvs_get_swap_colors());
+  flatjson_add_int(&w, "wifi_power_save", nvs_get_wifi_power_save());
+  flatjson_add_bool(&w, "skip_display_version",
+                    nvs_get_skip_display_version());
+  flatjson_add_bool(&w, "skip_boot_animation", nvs_get_skip_boot_animation());
+  flatjson_add_bool(&w, "ap_mode", nvs_get_ap_mode());
+  flatjson_add_bool(&w, "prefer_ipv6", nvs_get_prefer_ipv6());
+  flatjson_add_bool(&w, "disable_touch", nvs_get_disable_touch());
+  flatjson_add_int(&w, "rotation", nvs_get_rotation());
+  flatjson_add_bool(&w, "mirror", nvs_get_mirror());
+  flatjson_add_int(&w, "zone_layout", nvs_get_zone_layout());
+  // Initial push credits; queued/displaying notifications update them
+  int used, capacity;
+  gfx_get_queue_occupancy(&used, &capacity);
+  size_t credit_bytes;
+  int credits = bufpool_credits(capacity - used, &credit_bytes);
+  flatjson_add_int(&w, "credits", credits);
+  flatjson_add_int(&w, "credit_bytes", (int)credit_bytes);
+  flatjson_end_object(&w);
+  flatjson_end_object(&w);
+
+  int len = flatjson_writer_finish(&w);
+  if (len < 0) {
+    ESP_LOGE(TAG, "Client info does not fit in %d bytes", CLIENT_INFO_MAX_LEN);
+    return ESP_ERR_NO_MEM;
+  }
+  ESP_LOGI(TAG, "Sending client info: %s", json);
+  int sent =
+      esp_websocket_client_send_text(ws_handle, json, len, portMAX_DELAY);
+  if (sent < 0) {
+    ESP_LOGE(TAG, "Failed to send client info: %d", sent);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+// Settings changed by control messages are written to NVS together once
+// they have been quiet for this long, so a burst of messages costs one
+// flash commit
+#define SETTINGS_SAVE_DELAY_US (2 * 1000 * 1000)
+
+static esp_timer_handle_t settings_save_timer;
+static volatile bool settings_dirty = false;
+
+static void settings_save_timer_cb(void* arg) {
+  app_events_post(APP_EVENT_SETTINGS_DIRTY);
+}
+
+static void schedule_settings_save(void) {
+  settings_dirty = true;
+  if (settings_save_timer == NULL) return;
+  esp_timer_stop(settings_save_timer);  // Restart the quiet period
+  esp_timer_start_once(settings_save_timer, SETTINGS_SAVE_DELAY_US);
+}
+
+// Commits settings changed by control messages. Called from the push loops
+// once the quiet period ends, and before a reboot.
+static void save_pending_settings(void) {
+  if (!settings_dirty) return;
+  settings_dirty = false;
+
+  esp_err_t err = nvs_save_settings();
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to save settings: %s", esp_err_to_name(err));
+    return;
+  }
+  app_events_post(APP_EVENT_CONFIG_CHANGED);
+  // Only the WebSocket has a channel back to the server
+  if (use_websocket) send_client_info();
+}
+
+// Called from the push loops on every wake; only saves once the quiet period
+// after the last change has run out, so bursts of changes are coalesced.
+static void save_settings_when_quiet(void) {
+  if (settings_save_timer != NULL && esp_timer_is_active(settings_save_timer)) {
+    return;
+  }
+  save_pending_settings();
+}
+
+// What a control message asked for beyond its individual settings, applied
+// once all of its keys have been seen
+struct control_result {
+  bool settings_changed;
+  bool orientation_changed;
+  bool reboot;
+  // Retained MQTT message the broker replays on every connect; one-shot
+  // commands in it would repeat after each reboot
+  bool retained;
+};
+
+typedef void (*control_handler_t)(const flatjson_value_t* value,
+                                  struct control_result* result);
+
+static void control_immediate(const flatjson_value_t* value,
+                              struct control_result* result) {
+  if (!value->boolean) return;
+  ESP_LOGD(TAG, "Interrupting current animation to load queued image");
+  gfx_preempt();
+}
+
+static void control_dwell_secs(const flatjson_value_t* value,
+                               struct control_result* result) {
+  int dwell_value = value->integer;
+  if (dwell_value < 1) dwell_value = 1;
+  if (dwell_value > 3600) dwell_value = 3600;
+  app_dwell_secs = dwell_value;
+  ESP_LOGD(TAG, "Updated dwell_secs to %" PRId32 " seconds", app_dwell_secs);
+}
+
+static void control_brightness(const flatjson_value_t* value,
+                               struct control_result* result) {
+  int brightness_value = value->integer;
+  if (brightness_value < DISPLAY_MIN_BRIGHTNESS)
+    brightness_value = DISPLAY_MIN_BRIGHTNESS;
+  if (brightness_value > DISPLAY_MAX_BRIGHTNESS)
+    brightness_value = DISPLAY_MAX_BRIGHTNESS;
+  display_set_brightness((uint8_t)brightness_value);
+  ESP_LOGI(TAG, "Updated brightness to %d", brightness_value);
+#ifdef CONFIG_BOARD_TIDBYT_GEN2
+  // Sync touch control state - server brightness command means
+  // display is on
+  display_power_on = true;
+  saved_brightness = (uint8_t)brightness_value;
+#endif
+}
+
+static void control_ota_url(const flatjson_value_t* value,
+                            struct control_result* result) {
+  if (result->retained) {
+    ESP_LOGW(TAG, "Ignoring ota_url in a retained message");
+    return;
+  }
+  char* ota_url = strdup(value->string);
+  if (ota_url) {
+    ESP_LOGI(TAG, "OTA URL received via push: %s", ota_url);
+    xTaskCreate(ota_task_entry, "ota_task", 8192, ota_url, 5, NULL);
+  }
+}
+
+static void control_swap_colors(const flatjson_value_t* value,
+                                struct control_result* result) {
+  nvs_set_swap_colors(value->boolean);
+  ESP_LOGI(TAG, "Updated swap_colors to %d", value->boolean);
+  result->settings_changed = true;
+}
+
+static void control_wifi_power_save(const flatjson_value_t* value,
+                                    struct control_result* result) {
+  wifi_ps_type_t val = (wifi_ps_type_t)value->integer;
+  nvs_set_wifi_power_save(val);
+  ESP_LOGI(TAG, "Updated wifi_power_save to %d", val);
+  result->settings_changed = true;
+  wifi_apply_power_save();
+}
+
+static void control_skip_display_version(const flatjson_value_t* value,
+                                         struct control_result* result) {
+  nvs_set_skip_display_version(value->boolean);
+  ESP_LOGI(TAG, "Updated skip_display_version to %d", value->boolean);
+  result->settings_changed = true;
+}
+
+static void control_skip_boot_animation(const flatjson_value_t* value,
+                                        struct control_result* result) {
+  nvs_set_skip_boot_animation(value->boolean);
+  ESP_LOGI(TAG, "Updated skip_boot_animation to %d", value->boolean);
+  result->settings_changed = true;
+}
+
+static void control_ap_mode(const flatjson_value_t* value,
+                            struct control_result* result) {
+  nvs_set_ap_mode(value->boolean);
+  ESP_LOGI(TAG, "Updated ap_mode to %d", value->boolean);
+  result->settings_changed = true;
+}
+
+static void control_prefer_ipv6(const flatjson_value_t* value,
+                                struct control_result* result) {
+  nvs_set_prefer_ipv6(value->boolean);
+  ESP_LOGI(TAG, "Updated prefer_ipv6 to %d", value->boolean);
+  result->settings_changed = true;
+}
+
+static void control_disable_touch(const flatjson_value_t* value,
+                                  struct control_result* result) {
+  nvs_set_disable_touch(value->boolean);
+  ESP_LOGI(TAG, "Updated disable_touch to %d", value->boolean);
+  result->settings_changed = true;
+}
+
+// "rotation" (degrees) and "mirror" are applied together once the whole
+// message has been read
+static void control_rotation(const flatjson_value_t* value,
+                             struct control_result* result) {
+  if (nvs_set_rotation((uint16_t)value->integer) != ESP_OK) {
+    ESP_LOGW(TAG, "Invalid rotation received: %d", value->integer);
+    return;
+  }
+  result->orientation_changed = true;
+}
+
+static void control_mirror(const flatjson_value_t* value,
+                           struct control_result* result) {
+  nvs_set_mirror(value->boolean);
+  result->orientation_changed = true;
+}
+
+static void control_zone_layout(const flatjson_value_t* value,
+                                struct control_result* result) {
+  int val = value->integer;
+  if (val >= GFX_ZONES_SINGLE && val <= GFX_ZONES_TICKER) {
+    nvs_set_zone_layout((uint8_t)val);
+    gfx_set_zone_layout((uint8_t)val);
+    ESP_LOGI(TAG, "Updated zone_layout to %d", val);
+    result->settings_changed = true;
+  } else {
+    ESP_LOGW(TAG, "Invalid zone_layout received: %d", val);
+  }
+}
+
+// "zone", "priority" and "ttl_secs" only apply to the next pushed image
+static void control_zone(const flatjson_value_t* value,
+                         struct control_result* result) {
+  portENTER_CRITICAL(&next_push_lock);
+  next_push.zone = value->integer;
+  portEXIT_CRITICAL(&next_push_lock);
+}
+
+static void control_priority(const flatjson_value_t* value,
+                             struct control_result* result) {
+  gfx_priority_t priority = GFX_PRIORITY_NORMAL;
+  if (strcmp(value->string, "immediate") == 0) {
+    priority = GFX_PRIORITY_IMMEDIATE;
+  } else if (strcmp(value->string, "background") == 0) {
+    priority = GFX_PRIORITY_BACKGROUND;
+  }
+  portENTER_CRITICAL(&next_push_lock);
+  next_push.priority = priority;
+  portEXIT_CRITICAL(&next_push_lock);
+}
+
+static void control_ttl_secs(const flatjson_value_t* value,
+                             struct control_result* result) {
+  if (value->integer <= 0) return;
+  portENTER_CRITICAL(&next_push_lock);
+  next_push.ttl_secs = (uint32_t)value->integer;
+  portEXIT_CRITICAL(&next_push_lock);
+}
+
+static void control_hostname(const flatjson_value_t* value,
+                             struct control_result* result) {
+  const char* new_hostname = value->string;
+  if (value->string_len > 0 && value->string_len <= MAX_HOSTNAME_LEN) {
+    nvs_set_hostname(new_hostname);
+    wifi_set_hostname(new_hostname);
+    ESP_LOGI(TAG, "Updated hostname to %s", new_hostname);
+    result->settings_changed = true;
+  } else {
+    ESP_LOGW(TAG, "Invalid hostname received: %s", new_hostname);
+  }
+}
+
+static void control_syslog_addr(const flatjson_value_t* value,
+                                struct control_result* result) {
+  nvs_set_syslog_addr(value->string);
+  syslog_update_config(value->string);
+  ESP_LOGI(TAG, "Updated syslog_addr to %s", value->string);
+  result->settings_changed = true;
+}
+
+static void control_sntp_server(const flatjson_value_t* value,
+                                struct control_result* result) {
+  nvs_set_sntp_server(value->string);
+  // Note: SNTP reconfiguration usually requires restart or
+  // re-init logic which we don't have exposed. But settings are
+  // saved.
+  ESP_LOGI(TAG, "Updated sntp_server to %s", value->string);
+  result->settings_changed = true;
+}
+
+static void control_image_url(const flatjson_value_t* value,
+                              struct control_result* result) {
+  nvs_set_image_url(value->string);
+  ESP_LOGI(TAG, "Updated image_url to %s", nvs_get_image_url());
+  result->settings_changed = true;
+}
+
+static void control_protocol_version(const flatjson_value_t* value,
+                                     struct control_result* result) {
+  if (value->integer < 1 || value->integer > WEBSOCKET_PROTOCOL_VERSION) {
+    ESP_LOGW(TAG, "Unsupported protocol_version: %d", value->integer);
+    return;
+  }
+  ws_protocol_version = value->integer;
+  ESP_LOGI(TAG, "Using WebSocket protocol v%d", ws_protocol_version);
+}
+
+static void control_telemetry_secs(const flatjson_value_t* value,
+                                   struct control_result* result) {
+  int secs = value->integer;
+  if (secs < 0) secs = 0;
+  if (secs > 3600) secs = 3600;
+  telemetry_set_interval(secs);
+  ESP_LOGI(TAG, "Updated telemetry interval to %d seconds", secs);
+}
+
+static void control_reboot(const flatjson_value_t* value,
+                           struct control_result* result) {
+  if (result->retained) {
+    ESP_LOGW(TAG, "Ignoring reboot in a retained message");
+    return;
+  }
+  if (value->boolean) result->reboot = true;
+}
+
+// Control message keys, each with the JSON type its value must have. New
+// commands only need a handler and a line here.
+static const struct {
+  const char* key;
+  flatjson_type_t type;
+  control_handler_t handler;
+} control_handlers[] = {
+    {"immediate", FLATJSON_BOOL, control_immediate},
+    {"dwell_secs", FLATJSON_NUMBER, control_dwell_secs},
+    {"brightness", FLATJSON_NUMBER, control_brightness},
+    {"ota_url", FLATJSON_STRING, control_ota_url},
+    {"swap_colors", FLATJSON_BOOL, control_swap_colors},
+    {"wifi_power_save", FLATJSON_NUMBER, control_wifi_power_save},
+    {"skip_display_version", FLATJSON_BOOL, control_skip_display_version},
+    {"skip_boot_animation", FLATJSON_BOOL, control_skip_boot_animation},
+    {"ap_mode", FLATJSON_BOOL, control_ap_mode},
+    {"prefer_ipv6", FLATJSON_BOOL, control_prefer_ipv6},
+    {"disable_touch", FLATJSON_BOOL, control_disable_touch},
+    {"rotation", FLATJSON_NUMBER, control_rotation},
+    {"mirror", FLATJSON_BOOL, control_mirror},
+    {"zone_layout", FLATJSON_NUMBER, control_zone_layout},
+    {"zone", FLATJSON_NUMBER, control_zone},
+    {"priority", FLATJSON_STRING, control_priority},
+    {"ttl_secs", FLATJSON_NUMBER, control_ttl_secs},
+    {"hostname", FLATJSON_STRING, control_hostname},
+    {"syslog_addr", FLATJSON_STRING, control_syslog_addr},
+    {"sntp_server", FLATJSON_STRING, control_sntp_server},
+    {"image_url", FLATJSON_STRING, control_image_url},
+    {"protocol_version", FLATJSON_NUMBER, control_protocol_version},
+    {"telemetry_secs", FLATJSON_NUMBER, control_telemetry_secs},
+    {"reboot", FLATJSON_BOOL, control_reboot},
+};
+
+static void dispatch_control_key(const char* key,
+                                 const flatjson_value_t* value, void* ctx) {
+  for (size_t i = 0; i < sizeof(control_handlers) / sizeof(control_handlers[0]);
+       i++) {
+    if (strcmp(control_handlers[i].key, key) != 0) continue;
+    // Mismatched types are ignored, as are unknown keys
+    if (value->type == control_handlers[i].type) {
+      control_handlers[i].handler(value, ctx);
+    }
+    return;
+  }
+}
+
+// Applies what a control message asked for once all of its keys are seen.
+static void finish_control_message(struct control_result* result) {
+  if (result->orientation_changed) {
+    display_set_orientation(nvs_get_rotation() / 90, nvs_get_mirror());
+    ESP_LOGI(TAG, "Updated rotation to %d, mirror to %d", nvs_get_rotation(),
+             nvs_get_mirror());
+    result->settings_changed = true;
+  }
+
+  if (result->settings_changed) schedule_settings_save();
+
+  if (result->reboot) {
+    ESP_LOGI(TAG, "Reboot command received via push");
+    save_pending_settings();
+    esp_restart();
+  }
+}
+
+// Applies a JSON control message from the server. Shared by the push
+// transports (WebSocket text frames, SSE events, MQTT control topics). The
+// message is read in place, so it needn't be NUL-terminated.
+static void handle_control_message(const char* json, size_t len,
+                                   bool retained) {
+  struct control_result result = {.retained = retained};
+  if (flatjson_parse(json, len, dispatch_control_key, &result) != 0) {
+    ESP_LOGW(TAG, "Failed to parse control message as JSON");
+  }
+  finish_control_message(&result);
+}
+
+// Applies a CBOR control message (WebSocket protocol v2).
+static void handle_control_cbor(const uint8_t* cbor, size_t len) {
+  struct control_result result = {0};
+  if (wsframe_parse_control(cbor, len, dispatch_control_key, &result) != 0) {
+    ESP_LOGW(TAG, "Failed to parse control message as CBOR");
+  }
+  finish_control_message(&result);
+}
+
+// Telemetry goes out as a v2 binary frame, once the server has opted in.
+static int send_telemetry_ws(const uint8_t* report, size_t len) {
+  static uint8_t frame[WSFRAME_HEADER_LEN + TELEMETRY_REPORT_MAX];
+  static uint32_t seq = 0;
+  if (ws_protocol_version < 2 ||
+      !esp_websocket_client_is_connected(ws_handle)) {
+    return 1;
+  }
+  wsframe_write_header(frame, WSFRAME_TYPE_TELEMETRY, seq++, report, len);
+  memcpy(frame + WSFRAME_HEADER_LEN, report, len);
+  int sent = esp_websocket_client_send_bin(
+      ws_handle, (const char*)frame, WSFRAME_HEADER_LEN + len,
+      pdMS_TO_TICKS(5000));
+  return sent < 0 ? 1 : 0;
+}
+
+static int send_telemetry_mqtt(const uint8_t* report, size_t len) {
+  return mqtt_push_publish("telemetry", report, len);
+}
+
+// Hands a complete pushed image to gfx, which takes ownership of it.
+static void queue_pushed_image(uint8_t* image, size_t len, int zone,
+                               gfx_priority_t priority, uint32_t ttl_secs,
+                               int32_t dwell_secs) {
+  if (bundle_is_bundle(image, len)) {
+    // A bundle sets its own options per image
+    if (!first_push_image_received) {
+      gfx_preempt();
+      first_push_image_received = true;
+    }
+    bundle_unpack(image, len, dwell_secs, NULL);
+    return;
+  }
+
+  if (zone != 0) {
+    // Side zones loop their image and do not take part in the dwell
+    if (gfx_update_zone(zone, image, len) != 0) {
+      bufpool_release(image);
+    }
+    return;
+  }
+
+  if (!first_push_image_received) {
+    // Preempt before queueing, so the new image can't be the one that gets
+    // interrupted
+    ESP_LOGI(TAG, "First pushed image received - interrupting boot animation");
+    gfx_preempt();
+    first_push_image_received = true;
+  }
+
+  // A single image ends the rotation of an earlier bundle
+  bundle_discard_held();
+  // Queue the complete binary data as a WebP image
+  // This will wait for the current animation to finish before loading
+  gfx_enqueue(image, len, dwell_secs, priority, ttl_secs);
+}
+
+// Queues a pushed image with the options set by the control messages
+// before it (WebSocket v1, SSE and MQTT).
+static void handle_pushed_image(uint8_t* image, size_t len) {
+  // Taken and reset in one step, so options set for a later image can't be
+  // lost or applied to this one half-written
+  portENTER_CRITICAL(&next_push_lock);
+  struct push_options options = next_push;
+  next_push = (struct push_options){0, GFX_PRIORITY_NORMAL, 0};
+  portEXIT_CRITICAL(&next_push_lock);
+  queue_pushed_image(image, len, options.zone, options.priority,
+                     options.ttl_secs, app_dwell_secs);
+}
+
+// Collects the v2 header at the start of a binary WebSocket message, which
+// the client may hand over in pieces. *used is set to the bytes of this data
+// event that belong to the header. Returns 1 once the header is parsed, 0 if
+// more of it is needed and -1 if it is invalid.
+static int take_frame_header(const esp_websocket_event_data_t* data,
+                             size_t* used) {
+  size_t want = WSFRAME_HEADER_LEN;
+  if (ws_header_got >= WSFRAME_HEADER_LEN &&
+      (ws_header_buf[2] & WSFRAME_FLAG_TIMESTAMP)) {
+    want += WSFRAME_TIMESTAMP_LEN;
+  }
+  *used = 0;
+  while (ws_header_got < want && *used < (size_t)data->data_len) {
+    size_t n = want - ws_header_got;
+    if (n > data->data_len - *used) n = data->data_len - *used;
+    memcpy(ws_header_buf + ws_header_got, data->data_ptr + *used, n);
+    ws_header_got += n;
+    *used += n;
+    // The flags byte decides whether a timestamp follows the fixed part
+    if (ws_header_got == WSFRAME_HEADER_LEN &&
+        (ws_header_buf[2] & WSFRAME_FLAG_TIMESTAMP)) {
+      want += WSFRAME_TIMESTAMP_LEN;
     }
-    cJSON_Delete(root);
+  }
+  if (ws_header_got < want) {
+    bool message_ends =
+        data->fin && data->payload_offset + data->data_len >= data->payload_len;
+    return message_ends ? -1 : 0;
+  }
+
+  ws_header_pending = false;
+  if (wsframe_parse_header(ws_header_buf, ws_header_got, &ws_frame) != 0) {
+    return -1;
+  }
+  ws_frame_crc = 0;
+  return 1;
+}
+
+// Applies a reassembled v2 control payload.
+static void handle_framed_control(uint8_t* payload, size_t len) {
+  if (ws_frame_crc != ws_frame.crc) {
+    ESP_LOGW(TAG, "Dropping control frame seq=%" PRIu32 ": CRC mismatch",
+             ws_frame.seq);
+  } else {
+    handle_control_cbor(payload, len);
+  }
+  bufpool_release(payload);
+}
+
+// Queues a reassembled v2 image with the options from its header.
+static void handle_framed_image(uint8_t* image, size_t len) {
+  if (ws_frame_crc != ws_frame.crc) {
+    ESP_LOGW(TAG, "Dropping image seq=%" PRIu32 ": CRC mismatch",
+             ws_frame.seq);
+    bufpool_release(image);
+    return;
+  }
+
+  // The server's clock stamp shows the end-to-end delivery delay, once SNTP
+  // has set ours
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  if (ws_frame.timestamp_ms != 0 && now.tv_sec > 1700000000) {
+    int64_t now_ms = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+    ESP_LOGI(TAG, "Image seq=%" PRIu32 " app=%s delivered after %lld ms",
+             ws_frame.seq, ws_frame.app_id,
+             now_ms - (int64_t)ws_frame.timestamp_ms);
   } else {
-    ret = ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Image seq=%" PRIu32 " app=%s", ws_frame.seq,
+             ws_frame.app_id);
+  }
+
+  gfx_priority_t priority = GFX_PRIORITY_NORMAL;
+  if (ws_frame.flags & WSFRAME_FLAG_IMMEDIATE) {
+    priority = GFX_PRIORITY_IMMEDIATE;
+  } else if (ws_frame.flags & WSFRAME_FLAG_BACKGROUND) {
+    priority = GFX_PRIORITY_BACKGROUND;
   }
-  return ret;
+  int32_t dwell_secs =
+      ws_frame.dwell_secs > 0 ? ws_frame.dwell_secs : app_dwell_secs;
+  queue_pushed_image(image, len, ws_frame.zone, priority, ws_frame.ttl_secs,
+                     dwell_secs);
 }
 
 static void websocket_event_handler(void* handler_args, esp_event_base_t base,
@@ -156,10 +734,15 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
   switch (event_id) {
     case WEBSOCKET_EVENT_CONNECTED:
       ESP_LOGI(TAG, "WEBSOCKET_EVENT_CONNECTED");
+      // Each connection starts at v1 until the server confirms v2
+      ws_protocol_version = 1;
+      telemetry_note_connect();
       xEventGroupSetBits(s_ws_event_group, WS_CONNECTED_BIT);
+      app_events_post(APP_EVENT_PUSH_STATE);
       break;
     case WEBSOCKET_EVENT_DISCONNECTED:
       xEventGroupClearBits(s_ws_event_group, WS_CONNECTED_BIT);
+      app_events_post(APP_EVENT_PUSH_STATE);
       break;
     case WEBSOCKET_EVENT_DATA:
       // Process text messages (op_code == 1)
@@ -172,210 +755,7 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
             (data->payload_offset + data->data_len >= data->payload_len);
 
         if (is_complete) {
-          // Ensure null-termination for cJSON
-          char* json_str = malloc(data->data_len + 1);
-          if (json_str) {
-            memcpy(json_str, data->data_ptr, data->data_len);
-            json_str[data->data_len] = '\0';
-            cJSON* root = cJSON_Parse(json_str);
-            free(json_str);
-
-            if (root) {
-              bool settings_changed = false;
-
-              // Check for "immediate"
-              cJSON* immediate_item = cJSON_GetObjectItem(root, "immediate");
-              if (cJSON_IsBool(immediate_item) &&
-                  cJSON_IsTrue(immediate_item)) {
-                ESP_LOGD(TAG,
-                         "Interrupting current animation to load queued image");
-                isAnimating = -1;
-              }
-
-              // Check for "dwell_secs"
-              cJSON* dwell_item = cJSON_GetObjectItem(root, "dwell_secs");
-              if (cJSON_IsNumber(dwell_item)) {
-                int dwell_value = dwell_item->valueint;
-                if (dwell_value < 1) dwell_value = 1;
-                if (dwell_value > 3600) dwell_value = 3600;
-                app_dwell_secs = dwell_value;
-                ESP_LOGD(TAG, "Updated dwell_secs to %" PRId32 " seconds",
-                         app_dwell_secs);
-              }
-
-              // Check for "brightness"
-              cJSON* brightness_item = cJSON_GetObjectItem(root, "brightness");
-              if (cJSON_IsNumber(brightness_item)) {
-                int brightness_value = brightness_item->valueint;
-                if (brightness_value < DISPLAY_MIN_BRIGHTNESS)
-                  brightness_value = DISPLAY_MIN_BRIGHTNESS;
-                if (brightness_value > DISPLAY_MAX_BRIGHTNESS)
-                  brightness_value = DISPLAY_MAX_BRIGHTNESS;
-                display_set_brightness((uint8_t)brightness_value);
-                ESP_LOGI(TAG, "Updated brightness to %d", brightness_value);
-#ifdef CONFIG_BOARD_TIDBYT_GEN2
-                // Sync touch control state - server brightness command means
-                // display is on
-                display_power_on = true;
-                saved_brightness = (uint8_t)brightness_value;
-#endif
-              }
-
-              // Check for "ota_url"
-              cJSON* ota_item = cJSON_GetObjectItem(root, "ota_url");
-              if (cJSON_IsString(ota_item) && (ota_item->valuestring != NULL)) {
-                char* ota_url = strdup(ota_item->valuestring);
-                if (ota_url) {
-                  ESP_LOGI(TAG, "OTA URL received via WS: %s", ota_url);
-                  xTaskCreate(ota_task_entry, "ota_task", 8192, ota_url, 5,
-                              NULL);
-                }
-              }
-
-              // Check for "swap_colors"
-              cJSON* swap_colors_item =
-                  cJSON_GetObjectItem(root, "swap_colors");
-              if (cJSON_IsBool(swap_colors_item)) {
-                bool val = cJSON_IsTrue(swap_colors_item);
-                nvs_set_swap_colors(val);
-                ESP_LOGI(TAG, "Updated swap_colors to %d", val);
-                settings_changed = true;
-              }
-
-              // Check for "wifi_power_save"
-              cJSON* wifi_ps_item =
-                  cJSON_GetObjectItem(root, "wifi_power_save");
-              if (cJSON_IsNumber(wifi_ps_item)) {
-                wifi_ps_type_t val = (wifi_ps_type_t)wifi_ps_item->valueint;
-                nvs_set_wifi_power_save(val);
-                ESP_LOGI(TAG, "Updated wifi_power_save to %d", val);
-                settings_changed = true;
-                wifi_apply_power_save();
-              }
-
-              // Check for "skip_display_version"
-              cJSON* skip_ver_item =
-                  cJSON_GetObjectItem(root, "skip_display_version");
-              if (cJSON_IsBool(skip_ver_item)) {
-                bool val = cJSON_IsTrue(skip_ver_item);
-                nvs_set_skip_display_version(val);
-                ESP_LOGI(TAG, "Updated skip_display_version to %d", val);
-                settings_changed = true;
-              }
-
-              // Check for "skip_boot_animation"
-              cJSON* skip_boot_item =
-                  cJSON_GetObjectItem(root, "skip_boot_animation");
-              if (cJSON_IsBool(skip_boot_item)) {
-                bool val = cJSON_IsTrue(skip_boot_item);
-                nvs_set_skip_boot_animation(val);
-                ESP_LOGI(TAG, "Updated skip_boot_animation to %d", val);
-                settings_changed = true;
-              }
-
-              // Check for "ap_mode"
-              cJSON* ap_mode_item = cJSON_GetObjectItem(root, "ap_mode");
-              if (cJSON_IsBool(ap_mode_item)) {
-                bool val = cJSON_IsTrue(ap_mode_item);
-                nvs_set_ap_mode(val);
-                ESP_LOGI(TAG, "Updated ap_mode to %d", val);
-                settings_changed = true;
-              }
-
-              // Check for "prefer_ipv6"
-              cJSON* prefer_ipv6_item =
-                  cJSON_GetObjectItem(root, "prefer_ipv6");
-              if (cJSON_IsBool(prefer_ipv6_item)) {
-                bool val = cJSON_IsTrue(prefer_ipv6_item);
-                nvs_set_prefer_ipv6(val);
-                ESP_LOGI(TAG, "Updated prefer_ipv6 to %d", val);
-                settings_changed = true;
-              }
-
-              // Check for "disable_touch"
-              cJSON* disable_touch_item =
-                  cJSON_GetObjectItem(root, "disable_touch");
-              if (cJSON_IsBool(disable_touch_item)) {
-                bool val = cJSON_IsTrue(disable_touch_item);
-                nvs_set_disable_touch(val);
-                ESP_LOGI(TAG, "Updated disable_touch to %d", val);
-                settings_changed = true;
-              }
-
-              // Check for "hostname"
-              cJSON* hostname_item = cJSON_GetObjectItem(root, "hostname");
-              if (cJSON_IsString(hostname_item) &&
-                  (hostname_item->valuestring != NULL)) {
-                const char* new_hostname = hostname_item->valuestring;
-                if (strlen(new_hostname) > 0 && strlen(new_hostname) <= 32) {
-                  nvs_set_hostname(new_hostname);
-                  wifi_set_hostname(new_hostname);
-                  ESP_LOGI(TAG, "Updated hostname to %s", new_hostname);
-                  settings_changed = true;
-                } else {
-                  ESP_LOGW(TAG, "Invalid hostname received: %s", new_hostname);
-                }
-              }
-
-              // Check for "syslog_addr"
-              cJSON* syslog_addr_item =
-                  cJSON_GetObjectItem(root, "syslog_addr");
-              if (cJSON_IsString(syslog_addr_item) &&
-                  (syslog_addr_item->valuestring != NULL)) {
-                const char* new_addr = syslog_addr_item->valuestring;
-                nvs_set_syslog_addr(new_addr);
-                syslog_update_config(new_addr);
-                ESP_LOGI(TAG, "Updated syslog_addr to %s", new_addr);
-                settings_changed = true;
-              }
-
-              // Check for "sntp_server"
-              cJSON* sntp_server_item =
-                  cJSON_GetObjectItem(root, "sntp_server");
-              if (cJSON_IsString(sntp_server_item) &&
-                  (sntp_server_item->valuestring != NULL)) {
-                const char* new_server = sntp_server_item->valuestring;
-                nvs_set_sntp_server(new_server);
-                // Note: SNTP reconfiguration usually requires restart or
-                // re-init logic which we don't have exposed. But settings are
-                // saved.
-                ESP_LOGI(TAG, "Updated sntp_server to %s", new_server);
-                settings_changed = true;
-              }
-
-              // Check for "image_url"
-              cJSON* image_url_item = cJSON_GetObjectItem(root, "image_url");
-              if (cJSON_IsString(image_url_item) &&
-                  (image_url_item->valuestring != NULL)) {
-                nvs_set_image_url(image_url_item->valuestring);
-                ESP_LOGI(TAG, "Updated image_url to %s", nvs_get_image_url());
-                settings_changed = true;
-              }
-
-              if (settings_changed) {
-                esp_err_t err = nvs_save_settings();
-                if (err == ESP_OK) {
-                  send_client_info();
-                } else {
-                  ESP_LOGE(TAG, "Failed to save settings: %s",
-                           esp_err_to_name(err));
-                }
-              }
-
-              // Check for "reboot"
-              cJSON* reboot_item = cJSON_GetObjectItem(root, "reboot");
-              if (cJSON_IsBool(reboot_item) && cJSON_IsTrue(reboot_item)) {
-                ESP_LOGI(TAG, "Reboot command received via WS");
-                esp_restart();
-              }
-
-              cJSON_Delete(root);
-            } else {
-              ESP_LOGW(TAG, "Failed to parse WebSocket text message as JSON");
-            }
-          } else {
-            ESP_LOGE(TAG, "Failed to allocate memory for JSON parsing");
-          }
+          handle_control_message(data->data_ptr, data->data_len, false);
         }
       } else if (data->op_code == 2 || data->op_code == 0) {
         // Binary data (WebP image) or Continuation
@@ -384,52 +764,111 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
         if (data->op_code == 2 && data->payload_offset == 0) {
           if (webp != NULL) {
             ESP_LOGW(TAG, "Discarding incomplete previous WebP buffer");
-            free(webp);
+            bufpool_release(webp);
             webp = NULL;
           }
           ws_accumulated_len = 0;
-          websocket_oversize_detected = false;
+          ws_discard_message = false;
+          ws_message_start_us = esp_timer_get_time();
+          ws_frame.header_len = 0;
+          ws_header_got = 0;
+          ws_header_pending = ws_protocol_version >= 2;
         }
 
         // Skip if oversize detected
-        if (websocket_oversize_detected) break;
+        if (ws_discard_message) break;
+
+        // A v2 header is not part of the payload; the buffer is set up once
+        // all of it is in
+        size_t skip = 0;
+        bool payload_starts = data->op_code == 2 && data->payload_offset == 0 &&
+                              !ws_header_pending;
+        if (ws_header_pending) {
+          int status = take_frame_header(data, &skip);
+          if (status < 0) {
+            ESP_LOGE(TAG, "Invalid v2 frame header (%zu bytes)",
+                     ws_header_got);
+            ws_discard_message = true;
+            break;
+          }
+          if (status == 0) break;
+          payload_starts = true;
+        }
 
-        // If Opcode 0 (Continuation) but no buffer, ignore (orphan or text
-        // continuation)
-        if (data->op_code == 0 && webp == NULL) break;
+        if (payload_starts) {
+          // Receive straight into a pool buffer when one is free, otherwise
+          // into one sized for the rest of the frame, so a single-frame
+          // message never reallocates
+          ws_buf_size = 0;
+          webp = bufpool_acquire(&ws_buf_size);
+          size_t frame_len =
+              data->payload_len - data->payload_offset - skip;
+          if (webp == NULL && frame_len <= CONFIG_HTTP_BUFFER_SIZE_MAX) {
+            webp = heap_caps_malloc(frame_len, MALLOC_CAP_SPIRAM);
+            if (webp == NULL) {
+              ESP_LOGE(TAG, "Failed to allocate memory (%zu bytes)",
+                       frame_len);
+              break;
+            }
+            ws_buf_size = frame_len;
+          }
+        }
 
-        // Resize buffer
-        size_t new_size = ws_accumulated_len + data->data_len;
-        if (new_size > CONFIG_HTTP_BUFFER_SIZE_MAX) {
+        const char* chunk = data->data_ptr + skip;
+        size_t chunk_len = data->data_len - skip;
+
+        // The end of this frame bounds the message so far; checking it up
+        // front rejects an oversize frame before any of it is copied
+        size_t new_size = ws_accumulated_len + chunk_len;
+        size_t frame_end = ws_accumulated_len + (data->payload_len -
+                                                 data->payload_offset - skip);
+        if (frame_end > CONFIG_HTTP_BUFFER_SIZE_MAX) {
+          new_size = frame_end;
           ESP_LOGE(TAG, "WebP size (%zu bytes) exceeds max (%d)", new_size,
                    CONFIG_HTTP_BUFFER_SIZE_MAX);
-          websocket_oversize_detected = true;
+          ws_discard_message = true;
           if (gfx_display_asset("oversize") != 0) {
             ESP_LOGE(TAG, "Failed to display oversize graphic");
           }
-          if (webp) {
-            free(webp);
-            webp = NULL;
-          }
+          bufpool_release(webp);
+          webp = NULL;
           ws_accumulated_len = 0;
           break;
         }
 
-        uint8_t* new_buf = heap_caps_realloc(webp, new_size, MALLOC_CAP_SPIRAM);
-        if (new_buf == NULL) {
-          ESP_LOGE(TAG, "Failed to allocate memory (%zu bytes)", new_size);
-          if (webp) {
-            free(webp);
+        // No buffer: an orphaned continuation (or text continuation), or the
+        // allocation at the start of the message failed
+        if (webp == NULL) break;
+
+        // Pool buffers are already CONFIG_HTTP_BUFFER_SIZE_MAX bytes; only a
+        // heap buffer grows, when a message spans several frames. It at least
+        // doubles, so the copies stay linear in the message size.
+        if (new_size > ws_buf_size) {
+          size_t grow_to = ws_buf_size * 2;
+          if (grow_to < frame_end) grow_to = frame_end;
+          if (grow_to > CONFIG_HTTP_BUFFER_SIZE_MAX) {
+            grow_to = CONFIG_HTTP_BUFFER_SIZE_MAX;
+          }
+          uint8_t* new_buf =
+              heap_caps_realloc(webp, grow_to, MALLOC_CAP_SPIRAM);
+          if (new_buf == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory (%zu bytes)", grow_to);
+            bufpool_release(webp);
             webp = NULL;
+            ws_accumulated_len = 0;
+            break;
           }
-          ws_accumulated_len = 0;
-          break;
+          webp = new_buf;
+          ws_buf_size = grow_to;
         }
-        webp = new_buf;
 
         // Append data
-        memcpy(webp + ws_accumulated_len, data->data_ptr, data->data_len);
+        memcpy(webp + ws_accumulated_len, chunk, chunk_len);
         ws_accumulated_len = new_size;
+        if (ws_frame.header_len > 0) {
+          ws_frame_crc =
+              esp_rom_crc32_le(ws_frame_crc, (const uint8_t*)chunk, chunk_len);
+        }
 
         // Check for completion
         // Frame is complete if we received the full payload of this frame
@@ -439,22 +878,22 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
         // Message is complete if this is the Final Frame (FIN) and we have all
         // of it
         if (data->fin && frame_complete) {
-          ESP_LOGD(TAG, "WebP download complete (%zu bytes)",
-                   ws_accumulated_len);
-
-          // Queue the complete binary data as a WebP image
-          // This will wait for the current animation to finish before loading
-          gfx_update(webp, ws_accumulated_len, app_dwell_secs);
-
-          if (!first_ws_image_received) {
-            ESP_LOGI(
-                TAG,
-                "First WebSocket image received - interrupting boot animation");
-            isAnimating = -1;
-            first_ws_image_received = true;
+          int64_t elapsed_us = esp_timer_get_time() - ws_message_start_us;
+          int64_t rate_bps =
+              elapsed_us > 0 ? ws_accumulated_len * 1000000LL / elapsed_us : 0;
+          ESP_LOGI(TAG, "WebP received (%zu bytes in %lld ms, %lld bytes/s)",
+                   ws_accumulated_len, elapsed_us / 1000, rate_bps);
+          telemetry_record_fetch_ms(elapsed_us / 1000);
+
+          if (ws_frame.header_len > 0 &&
+              ws_frame.type == WSFRAME_TYPE_CONTROL) {
+            handle_framed_control(webp, ws_accumulated_len);
+          } else if (ws_frame.header_len > 0) {
+            handle_framed_image(webp, ws_accumulated_len);
+          } else {
+            handle_pushed_image(webp, ws_accumulated_len);
           }
-
-          // Do not free(webp) here; ownership is transferred to gfx
+          // Ownership is transferred to gfx
           webp = NULL;
           ws_accumulated_len = 0;
         }
@@ -467,7 +906,7 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
       if (webp != NULL) {
         ESP_LOGW(TAG,
                  "WebSocket error with incomplete WebP buffer - discarding");
-        free(webp);
+        bufpool_release(webp);
         webp = NULL;
       }
       draw_error_indicator_pixel();
@@ -475,6 +914,83 @@ static void websocket_event_handler(void* handler_args, esp_event_base_t base,
   }
 }
 
+static void handle_control_json(const char* json) {
+  handle_control_message(json, strlen(json), false);
+}
+
+static void handle_mqtt_control(const char* json, bool retained) {
+  handle_control_message(json, strlen(json), retained);
+}
+
+// Fetches an image announced on the event stream. Settings arrive as control
+// events, so only the body and dwell of the response are used.
+static void fetch_pushed_image(const char* url) {
+  uint8_t* image = NULL;
+  size_t len = 0;
+  uint8_t brightness_pct;
+  int status_code = 0;
+  char* ota_url = NULL;
+  char* new_image_url = NULL;
+  bool reboot_requested = false;
+
+  display_show_sync_marker(true);
+  int err = remote_get(url, &image, &len, &brightness_pct, &app_dwell_secs,
+                       &status_code, &ota_url, &new_image_url,
+                       &reboot_requested);
+  display_show_sync_marker(false);
+  if (err != 0) {
+    ESP_LOGE(TAG, "Failed to fetch announced image (status %d)", status_code);
+    draw_error_indicator_pixel();
+    return;
+  }
+  free(ota_url);
+  free(new_image_url);
+  if (image != NULL) {
+    handle_pushed_image(image, len);  // Not a 304
+  }
+}
+
+// RSSI below which the signal bars are shown; a good link shows nothing.
+#define WIFI_BARS_BELOW_RSSI -67
+
+// Shows a weak WiFi signal as bars in the corner of the display.
+static void show_wifi_signal(void) {
+  int8_t rssi;
+  if (wifi_get_rssi(&rssi) != 0 || rssi >= WIFI_BARS_BELOW_RSSI) {
+    // Disconnected is already shown by the status LED
+    display_show_wifi_bars(-1);
+    return;
+  }
+  display_show_wifi_bars(rssi >= -75 ? 2 : (rssi >= -85 ? 1 : 0));
+}
+
+// Smoothed fetch duration and its mean deviation (the RFC 6298 RTT
+// estimator), used to start the next HTTP fetch early enough to finish as
+// the current dwell ends.
+static int64_t fetch_srtt_us = 0;
+static int64_t fetch_rttvar_us = 0;
+
+static void fetch_time_sample(int64_t sample_us) {
+  if (fetch_srtt_us == 0) {
+    fetch_srtt_us = sample_us;
+    fetch_rttvar_us = sample_us / 2;
+    return;
+  }
+  int64_t err = sample_us - fetch_srtt_us;
+  fetch_rttvar_us += ((err < 0 ? -err : err) - fetch_rttvar_us) / 4;
+  fetch_srtt_us += err / 8;
+}
+
+// Lead time for the next fetch: the average plus two deviations, so a slow
+// fetch rarely overruns the dwell.
+static int64_t fetch_time_predict_us(void) {
+  return fetch_srtt_us + 2 * fetch_rttvar_us;
+}
+
+// Cap on how long a server's Retry-After or max-age can hold off the next
+// poll, so a bad header can't silence the device for days
+#define POLL_HINT_MAX_SECS 3600
+
 void app_main(void) {
   const char* image_url = NULL;
 
@@ -515,6 +1031,11 @@ void app_main(void) {
   // Initialize NVS settings
   ESP_ERROR_CHECK(nvs_settings_init());
 
+  if (app_events_initialize()) {
+    ESP_LOGE(TAG, "failed to initialize event bus");
+    return;
+  }
+
   // Setup WiFi.
   ESP_LOGI(TAG, "Initializing WiFi manager...");
   // Pass empty strings to force AP mode
@@ -526,12 +1047,25 @@ void app_main(void) {
 
   image_url = nvs_get_image_url();
 
+  // Reserve image buffers while PSRAM is still unfragmented
+  bufpool_initialize();
+
   // Setup the display.
   if (gfx_initialize(image_url)) {
     ESP_LOGE(TAG, "failed to initialize gfx");
     return;
   }
   esp_register_shutdown_handler(&display_shutdown);
+  bundle_initialize();
+
+  const esp_timer_create_args_t settings_save_timer_args = {
+      .callback = settings_save_timer_cb,
+      .name = "settings_save",
+  };
+  if (esp_timer_create(&settings_save_timer_args, &settings_save_timer) !=
+      ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create settings save timer");
+  }
 
 #ifdef CONFIG_BOARD_TIDBYT_GEN2
   // Initialize touch controls (GPIO33 on Tidbyt Gen2)
@@ -541,6 +1075,7 @@ void app_main(void) {
     if (touch_ret == ESP_OK) {
       ESP_LOGI(TAG, "Touch control ready on GPIO33");
       touch_control_debug_all_pads();
+      xTaskCreate(touch_task, "touch", 3072, NULL, 4, NULL);
     } else {
       ESP_LOGW(TAG, "Touch control init failed: %s (continuing without touch)",
                esp_err_to_name(touch_ret));
@@ -636,25 +1171,22 @@ void app_main(void) {
     } else {
       ESP_LOGW(TAG,
                "Boot button pressed - waiting for configuration or timeout...");
-      int config_wait_counter = 0;
-      while (config_wait_counter < 120) {  // Wait up xx seconds
-        // Check if configuration was received
-        if (config_received) {
-          ESP_LOGI(TAG, "Configuration received - proceeding");
-          break;
-        }
-
-        config_wait_counter++;
-        vTaskDelay(pdMS_TO_TICKS(1 * 1000));
+      // Wait up to 120 seconds
+      int64_t config_wait_end = esp_timer_get_time() + 120 * 1000000LL;
+      while (!config_received) {
+        int64_t remaining_us = config_wait_end - esp_timer_get_time();
+        if (remaining_us <= 0) break;
+        app_events_wait(APP_EVENT_CONFIG_CHANGED,
+                        pdMS_TO_TICKS(remaining_us / 1000));
+      }
+      if (config_received) {
+        ESP_LOGI(TAG, "Configuration received - proceeding");
       }
     }
   } else if (!wifi_is_connected()) {
     ESP_LOGW(TAG, "Pausing main task until wifi connected...");
     while (!wifi_is_connected()) {
-      static int counter = 0;
-      counter++;
-      vTaskDelay(pdMS_TO_TICKS(1 * 1000));
-      if (counter > 600)
+      if (!app_events_wait(APP_EVENT_WIFI_UP, pdMS_TO_TICKS(600 * 1000)))
         esp_restart();  // after 10 minutes reboot because maybe we got stuck
                         // here after power outage or something.
     }
@@ -674,7 +1206,7 @@ void app_main(void) {
     }
 
     ESP_LOGW(TAG, "Image URL is not set. Waiting for configuration...");
-    vTaskDelay(pdMS_TO_TICKS(5000));
+    app_events_wait(APP_EVENT_CONFIG_CHANGED, pdMS_TO_TICKS(5000));
   }
 
   // image_url is now valid and usable here
@@ -721,6 +1253,8 @@ void app_main(void) {
 
     // Set the websocket handle in gfx module for bidirectional communication
     gfx_set_websocket_handle(ws_handle);
+    wsout_initialize(ws_handle);
+    telemetry_start(CONFIG_TELEMETRY_INTERVAL_SECONDS, send_telemetry_ws);
 
     // Create event group for WebSocket connection
     s_ws_event_group = xEventGroupCreate();
@@ -774,6 +1308,7 @@ void app_main(void) {
         }
         last_connected_time = now;
         client_started = true;  // Mark as started if we ever connect
+        clear_error_indicator_pixel();
       } else {
         if (was_connected) {
           was_connected = false;
@@ -810,33 +1345,129 @@ void app_main(void) {
       }
 
       wifi_health_check();
+      show_wifi_signal();
+      save_settings_when_quiet();
 
-#ifdef CONFIG_BOARD_TIDBYT_GEN2
-      // Poll touch frequently for 5 seconds (50ms intervals = 100 checks)
-      // This allows proper gesture detection while keeping health checks at 5s
-      if (nvs_get_disable_touch()) {
-        vTaskDelay(pdMS_TO_TICKS(5000));
+      // Sleep until the connection changes state, settings need saving, or
+      // the 5 second health check interval
+      app_events_wait(APP_EVENT_PUSH_STATE | APP_EVENT_SETTINGS_DIRTY,
+                      pdMS_TO_TICKS(5000));
+    }
+  } else if (mqtt_push_is_url(image_url)) {
+    ESP_LOGI(TAG, "Using MQTT with URL: %s", image_url);
+    if (mqtt_push_start(image_url, handle_mqtt_control, handle_pushed_image) !=
+        0) {
+      ESP_LOGE(TAG, "Failed to start the MQTT client");
+    }
+    telemetry_start(CONFIG_TELEMETRY_INTERVAL_SECONDS, send_telemetry_mqtt);
+
+    // Messages are handled on the MQTT task, which also reconnects
+    bool was_connected = false;
+    for (;;) {
+      bool connected = mqtt_push_is_connected();
+      if (connected && !was_connected) telemetry_note_connect();
+      was_connected = connected;
+      if (connected) {
+        clear_error_indicator_pixel();
       } else {
-        for (int i = 0; i < 100; i++) {
-          touch_event_t touch_event = touch_control_check();
-          if (touch_event != TOUCH_EVENT_NONE) {
-            handle_touch_event(touch_event);
-          }
-          vTaskDelay(pdMS_TO_TICKS(50));  // 50ms = responsive touch
-        }
+        draw_error_indicator_pixel();
       }
-#else
-      vTaskDelay(pdMS_TO_TICKS(5000));  // 5 second health check interval
-#endif
+      wifi_health_check();
+      show_wifi_signal();
+      save_settings_when_quiet();
+      app_events_wait(APP_EVENT_PUSH_STATE | APP_EVENT_SETTINGS_DIRTY,
+                      pdMS_TO_TICKS(5000));
+    }
+  } else if (sse_is_url(image_url)) {
+    ESP_LOGI(TAG, "Using server-sent events with URL: %s", image_url);
+    if (sse_start(image_url, handle_control_json) != 0) {
+      ESP_LOGE(TAG, "Failed to start the SSE client");
+    }
+
+    for (;;) {
+      // Images are announced on the stream and fetched with the shared
+      // keep-alive client; only the newest announcement is fetched
+      char* announced_url = sse_take_image_url();
+      if (announced_url != NULL) {
+        fetch_pushed_image(announced_url);
+        free(announced_url);
+      }
+
+      if (sse_is_connected()) {
+        clear_error_indicator_pixel();
+      } else {
+        draw_error_indicator_pixel();
+      }
+      wifi_health_check();
+      show_wifi_signal();
+      save_settings_when_quiet();
+
+      app_events_wait(APP_EVENT_PUSH_IMAGE | APP_EVENT_PUSH_STATE |
+                          APP_EVENT_SETTINGS_DIRTY,
+                      pdMS_TO_TICKS(5000));
     }
   } else {
     // normal http
     ESP_LOGW(TAG, "HTTP Loop Start with URL: %s", image_url);
+    // When the image on screen started its dwell, and how long that is. The
+    // next fetch is timed to complete as that dwell ends.
+    int64_t dwell_start_us = 0;
+    int32_t showing_dwell_secs = 0;
+    // A bundle's rotation spans several dwells, so the end of one doesn't
+    // bring the next fetch forward
+    bool showing_bundle = false;
+    // Set when the server asked for the next poll at a given time
+    // (Retry-After, Cache-Control max-age)
+    int64_t poll_at_us = 0;
+    // The server holds requests until its content changes, so it paces the
+    // polls instead of the dwell
+    bool long_polling = false;
+    // gfx counter of the last image fetched from image_url, 0 if none
+    int fetched_counter = 0;
     for (;;) {
       uint8_t* webp;
       size_t len;
       static uint8_t brightness_pct = DISPLAY_DEFAULT_BRIGHTNESS;
       int status_code = 0;
+
+      if (poll_at_us != 0) {
+        ESP_LOGI(TAG, "Server asked for the next poll in %lld s",
+                 (poll_at_us - esp_timer_get_time()) / 1000000);
+        // A skip, a settings change or a reconnect fetches right away
+        for (;;) {
+          int64_t wait_us = poll_at_us - esp_timer_get_time();
+          if (wait_us <= 0) break;
+          EventBits_t events = app_events_wait(
+              APP_EVENT_TOUCH | APP_EVENT_CONFIG_CHANGED | APP_EVENT_WIFI_UP,
+              pdMS_TO_TICKS(wait_us / 1000) + 1);
+          if (events & (APP_EVENT_CONFIG_CHANGED | APP_EVENT_WIFI_UP)) break;
+          if ((events & APP_EVENT_TOUCH) && isAnimating == -1) break;
+        }
+        poll_at_us = 0;
+      } else if (dwell_start_us != 0 && !long_polling) {
+        int64_t lead_us = fetch_time_predict_us();
+        int64_t fetch_at_us =
+            dwell_start_us + showing_dwell_secs * 1000000LL - lead_us;
+        ESP_LOGD(TAG, "Next fetch in %lld ms (predicted fetch %lld ms)",
+                 (fetch_at_us - esp_timer_get_time()) / 1000, lead_us / 1000);
+        // Go early if the dwell is cut short (skip, preemption)
+        while (isAnimating > 0 || showing_bundle) {
+          int64_t wait_us = fetch_at_us - esp_timer_get_time();
+          if (wait_us <= 0) break;
+          app_events_wait(APP_EVENT_ANIMATION_DONE | APP_EVENT_TOUCH,
+                          pdMS_TO_TICKS(wait_us / 1000) + 1);
+        }
+      }
+
+      if (fetched_counter != 0 &&
+          gfx_get_failed_counter() == fetched_counter) {
+        // Otherwise the server answers 304 and the error stays up until the
+        // content changes
+        ESP_LOGW(TAG, "Last image failed to decode, fetching it in full");
+        remote_forget_validator(image_url);
+        fetched_counter = 0;
+      }
+
       ESP_LOGI(TAG, "Fetching from URL: %s", image_url);
       char* ota_url = NULL;
       char* new_image_url = NULL;
@@ -844,14 +1475,39 @@ void app_main(void) {
 
       // Start timing the HTTP fetch
       int64_t fetch_start_us = esp_timer_get_time();
+      display_show_sync_marker(true);
       bool fetch_failed = !wifi_is_connected() ||
                           remote_get(image_url, &webp, &len, &brightness_pct,
                                      &app_dwell_secs, &status_code, &ota_url,
                                      &new_image_url, &reboot_requested);
+      display_show_sync_marker(false);
       int64_t fetch_duration_ms =
           (esp_timer_get_time() - fetch_start_us) / 1000;
 
       ESP_LOGI(TAG, "HTTP fetch returned in %lld ms", fetch_duration_ms);
+      if (!fetch_failed && !long_polling) {
+        // A long poll's duration is mostly the server waiting, not transfer
+        fetch_time_sample(esp_timer_get_time() - fetch_start_us);
+      }
+
+      remote_poll_hint_t hint;
+      remote_get_poll_hint(&hint);
+      long_polling = hint.long_poll_secs > 0;
+      int32_t poll_in_secs = hint.retry_after_secs;
+      if (poll_in_secs < 0) {
+        // A new image is fetched again as its dwell ends; max-age only
+        // holds that off when it lasts longer
+        bool new_image = !fetch_failed && webp != NULL;
+        if (!new_image || hint.max_age_secs > app_dwell_secs) {
+          poll_in_secs = hint.max_age_secs;
+        }
+      }
+      if (poll_in_secs > 0) {
+        if (poll_in_secs > POLL_HINT_MAX_SECS) {
+          poll_in_secs = POLL_HINT_MAX_SECS;
+        }
+        poll_at_us = esp_timer_get_time() + poll_in_secs * 1000000LL;
+      }
 
       if (ota_url != NULL) {
         ESP_LOGI(TAG, "OTA URL received via HTTP: %s", ota_url);
@@ -892,20 +1548,54 @@ void app_main(void) {
                    "Content too large - oversize graphic already displayed");
           vTaskDelay(pdMS_TO_TICKS(1 * 5000));
         }
+      } else if (webp == NULL) {
+        // 304 Not Modified: gfx keeps looping the current image, so just let
+        // it run for another dwell before asking again
+        clear_error_indicator_pixel();
+        display_set_brightness(brightness_pct);
+        ESP_LOGI(TAG, "Image unchanged, extending dwell");
+        // A long poll that timed out is simply renewed
+        while (isAnimating > 0 && !long_polling) {
+          app_events_wait(APP_EVENT_ANIMATION_DONE | APP_EVENT_TOUCH,
+                          pdMS_TO_TICKS(1000));
+        }
+        if (isAnimating != -1) {
+          isAnimating = 1;
+          dwell_start_us = esp_timer_get_time();
+        } else {
+          vTaskDelay(pdMS_TO_TICKS(1000));  // Don't spin while interrupted
+        }
+      } else if (bundle_is_bundle(webp, len)) {
+        clear_error_indicator_pixel();
+        display_set_brightness(brightness_pct);
+        int32_t rotation_secs = 0;
+        bundle_unpack(webp, len, app_dwell_secs, &rotation_secs);
+        webp = NULL;
+        // Poll again once the whole rotation has played
+        dwell_start_us = esp_timer_get_time();
+        showing_dwell_secs = rotation_secs;
+        showing_bundle = true;
       } else {
         // Successful remote_get
+        clear_error_indicator_pixel();
         display_set_brightness(brightness_pct);
         ESP_LOGI(TAG, "Queuing new webp (%d bytes)", len);
 
-        int queued_counter = gfx_update(webp, len, app_dwell_secs);
+        int32_t queued_dwell_secs = app_dwell_secs;
+        bundle_discard_held();
+        int queued_counter = gfx_update(webp, len, queued_dwell_secs);
+        fetched_counter = queued_counter;
         // Do not free(webp) here; ownership is transferred to gfx
         webp = NULL;
 
-        // Wait for the current animation to finish (isAnimating will be 0)
-        if (isAnimating > 0) {
+        // Wait for the current animation to finish (isAnimating will be 0).
+        // Long polls go straight back out; the gfx queue holds the image.
+        if (isAnimating > 0 && !long_polling) {
           ESP_LOGI(TAG, "Waiting for current webp to finish");
           while (isAnimating > 0) {
-            vTaskDelay(pdMS_TO_TICKS(1));
+            // The timeout only guards against a missed post
+            app_events_wait(APP_EVENT_ANIMATION_DONE | APP_EVENT_TOUCH,
+                            pdMS_TO_TICKS(1000));
           }
         }
 
@@ -914,12 +1604,16 @@ void app_main(void) {
         // again
         // ESP_LOGI(TAG, "Waiting for gfx task to load new image (counter=%d)",
         // queued_counter);
-        int timeout = 0;
-        while (gfx_get_loaded_counter() != queued_counter && timeout < 20000) {
-          vTaskDelay(pdMS_TO_TICKS(10));
-          timeout += 10;
+        int64_t load_deadline = esp_timer_get_time() + 20000 * 1000LL;
+        while (!long_polling && gfx_get_loaded_counter() != queued_counter) {
+          int64_t remaining_us = load_deadline - esp_timer_get_time();
+          if (remaining_us <= 0) break;
+          app_events_wait(APP_EVENT_IMAGE_LOADED,
+                          pdMS_TO_TICKS(remaining_us / 1000) + 1);
         }
-        if (timeout >= 20000) {
+        if (long_polling) {
+          ESP_LOGD(TAG, "Queued image counter %d", queued_counter);
+        } else if (gfx_get_loaded_counter() != queued_counter) {
           ESP_LOGE(TAG, "Timeout waiting for gfx task to load image");
         } else {
           ESP_LOGI(TAG, "Gfx task loaded image counter %d ms", queued_counter);
@@ -930,24 +1624,18 @@ void app_main(void) {
         if (isAnimating != -1) {
           isAnimating = 1;
         }
+        dwell_start_us = esp_timer_get_time();
+        showing_dwell_secs = queued_dwell_secs;
+        showing_bundle = false;
       }
 
-#ifdef CONFIG_BOARD_TIDBYT_GEN2
-      // Check for touch events
-      if (!nvs_get_disable_touch()) {
-        touch_event_t touch_event = touch_control_check();
-        if (touch_event != TOUCH_EVENT_NONE) {
-          handle_touch_event(touch_event);
-        }
-      }
-#endif
-
       if (reboot_requested) {
         ESP_LOGI(TAG, "Rebooting");
         esp_restart();
       }
 
       wifi_health_check();
+      show_wifi_signal();
     }
   }
 }
@@ -966,7 +1654,7 @@ static void handle_touch_event(touch_event_t event) {
     case TOUCH_EVENT_TAP:
       if (display_power_on) {
         ESP_LOGI(TAG, "TAP - skip to next app");
-        isAnimating = -1;
+        gfx_preempt();
       } else {
         ESP_LOGI(TAG, "TAP ignored - display is off (hold to turn on)");
       }
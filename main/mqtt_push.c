@@ -0,0 +1,334 @@
+#include "mqtt_push.h"
+
+#include <esp_crt_bundle.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mqtt_client.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_events.h"
+#include "bufpool.h"
+#include "gfx.h"
+#include "nvs_settings.h"
+#include "sdkconfig.h"
+#include "wifi.h"
+
+static const char *TAG = "mqtt_push";
+
+#define MQTT_PUSH_DEFAULT_BASE "tronbyt"
+#define MQTT_PUSH_MAX_GROUPS 4
+#define MQTT_PUSH_GROUP_LEN 32
+#define MQTT_PUSH_TOPIC_LEN 96
+// Payloads arrive in fragments of this size and are reassembled here
+#define MQTT_PUSH_BUFFER 2048
+// Runs TLS and the control handler, like the WebSocket client's task
+#define MQTT_PUSH_TASK_STACK 8192
+#define MQTT_PUSH_CONTROL_MAX 4096
+
+typedef enum {
+  MESSAGE_NONE,  // Ignored, or dropped part way through
+  MESSAGE_CONTROL,
+  MESSAGE_IMAGE,
+} message_kind_t;
+
+struct mqtt_push_state {
+  char broker_uri[MAX_URL_LEN + 1];  // URL without path and query
+  char base[MQTT_PUSH_TOPIC_LEN];
+  char device_id[13];  // MAC as 12 hex digits
+  char groups[MQTT_PUSH_MAX_GROUPS][MQTT_PUSH_GROUP_LEN + 1];
+  int group_count;
+  char status_topic[MQTT_PUSH_TOPIC_LEN];
+  mqtt_push_control_cb_t on_control;
+  mqtt_push_image_cb_t on_image;
+  esp_mqtt_client_handle_t client;
+  // Message being reassembled
+  message_kind_t kind;
+  bool retained;
+  uint8_t *buf;
+  size_t len;
+};
+
+static struct mqtt_push_state *_state;
+static volatile bool _connected;
+
+bool mqtt_push_is_url(const char *url) {
+  return strncmp(url, "mqtt://", 7) == 0 || strncmp(url, "mqtts://", 8) == 0;
+}
+
+static void set_connected(bool connected) {
+  if (_connected == connected) return;
+  _connected = connected;
+  ESP_LOGI(TAG, "Broker %s", connected ? "connected" : "disconnected");
+  app_events_post(APP_EVENT_PUSH_STATE);
+}
+
+// Splits url into the broker URI, the base topic and the groups.
+static int parse_url(struct mqtt_push_state *st, const char *url) {
+  const char *authority = strstr(url, "://") + 3;
+  const char *path = strchr(authority, '/');
+  const char *query = strchr(authority, '?');
+  if (query != NULL && (path == NULL || query < path)) path = NULL;
+
+  const char *uri_end =
+      path != NULL ? path : (query != NULL ? query : url + strlen(url));
+  if ((size_t)(uri_end - url) >= sizeof(st->broker_uri)) return 1;
+  memcpy(st->broker_uri, url, uri_end - url);
+  st->broker_uri[uri_end - url] = '\0';
+
+  if (path != NULL) {
+    path++;
+    size_t base_len = query != NULL ? (size_t)(query - path) : strlen(path);
+    while (base_len > 0 && path[base_len - 1] == '/') base_len--;
+    if (base_len >= sizeof(st->base)) return 1;
+    memcpy(st->base, path, base_len);
+    st->base[base_len] = '\0';
+  }
+  if (st->base[0] == '\0') {
+    strlcpy(st->base, MQTT_PUSH_DEFAULT_BASE, sizeof(st->base));
+  }
+
+  const char *groups = query != NULL ? strstr(query, "groups=") : NULL;
+  if (groups != NULL) {
+    groups += strlen("groups=");
+    while (*groups != '\0' && *groups != '&' &&
+           st->group_count < MQTT_PUSH_MAX_GROUPS) {
+      size_t n = strcspn(groups, ",&");
+      if (n > 0 && n <= MQTT_PUSH_GROUP_LEN) {
+        memcpy(st->groups[st->group_count], groups, n);
+        st->groups[st->group_count][n] = '\0';
+        st->group_count++;
+      } else if (n > 0) {
+        ESP_LOGW(TAG, "Ignoring group name longer than %d characters",
+                 MQTT_PUSH_GROUP_LEN);
+      }
+      groups += n;
+      if (*groups == ',') groups++;
+    }
+  }
+  return 0;
+}
+
+// Topics the device receives on under each prefix. A wildcard would also
+// deliver the device's own status and telemetry publishes back to it.
+static const char *const SUBSCRIBED_SUFFIXES[] = {"image", "control"};
+
+static void subscribe_prefix(struct mqtt_push_state *st, const char *prefix) {
+  char topic[MQTT_PUSH_TOPIC_LEN * 2];
+  for (size_t i = 0;
+       i < sizeof(SUBSCRIBED_SUFFIXES) / sizeof(SUBSCRIBED_SUFFIXES[0]); i++) {
+    snprintf(topic, sizeof(topic), "%s/%s", prefix, SUBSCRIBED_SUFFIXES[i]);
+    esp_mqtt_client_subscribe(st->client, topic, 1);
+  }
+}
+
+static void subscribe(struct mqtt_push_state *st) {
+  char prefix[MQTT_PUSH_TOPIC_LEN * 2];
+  snprintf(prefix, sizeof(prefix), "%s/%s", st->base, st->device_id);
+  subscribe_prefix(st, prefix);
+  for (int i = 0; i < st->group_count; i++) {
+    snprintf(prefix, sizeof(prefix), "%s/group/%s", st->base, st->groups[i]);
+    subscribe_prefix(st, prefix);
+  }
+  esp_mqtt_client_publish(st->client, st->status_topic, "online", 0, 1, 1);
+  ESP_LOGI(TAG, "Subscribed to %s/%s and %d group(s)", st->base,
+           st->device_id, st->group_count);
+}
+
+static bool topic_has_suffix(const char *topic, int topic_len,
+                             const char *suffix) {
+  int suffix_len = strlen(suffix);
+  return topic_len >= suffix_len &&
+         memcmp(topic + topic_len - suffix_len, suffix, suffix_len) == 0;
+}
+
+static void drop_message(struct mqtt_push_state *st) {
+  bufpool_release(st->buf);
+  st->buf = NULL;
+  st->len = 0;
+  st->kind = MESSAGE_NONE;
+}
+
+// Starts reassembling a message from its first fragment, which is the only
+// one that carries the topic.
+static void begin_message(struct mqtt_push_state *st,
+                          esp_mqtt_event_handle_t event) {
+  drop_message(st);
+  size_t total = event->total_data_len;
+  if (total == 0) return;  // A cleared retained message
+  st->retained = event->retain;
+
+  if (topic_has_suffix(event->topic, event->topic_len, "/image")) {
+    if (total > CONFIG_HTTP_BUFFER_SIZE_MAX) {
+      ESP_LOGE(TAG, "WebP size (%zu bytes) exceeds max (%d)", total,
+               CONFIG_HTTP_BUFFER_SIZE_MAX);
+      if (gfx_display_asset("oversize") != 0) {
+        ESP_LOGE(TAG, "Failed to display oversize graphic");
+      }
+      return;
+    }
+    // The total size is known up front, so the buffer never grows
+    size_t size = 0;
+    st->buf = bufpool_acquire(&size);
+    if (st->buf == NULL) st->buf = heap_caps_malloc(total, MALLOC_CAP_SPIRAM);
+    st->kind = MESSAGE_IMAGE;
+  } else if (topic_has_suffix(event->topic, event->topic_len, "/control")) {
+    if (total >= MQTT_PUSH_CONTROL_MAX) {
+      ESP_LOGW(TAG, "Dropping control message of %zu bytes", total);
+      return;
+    }
+    st->buf = malloc(total + 1);
+    st->kind = MESSAGE_CONTROL;
+  } else {
+    ESP_LOGD(TAG, "Ignoring message on %.*s", event->topic_len, event->topic);
+    return;
+  }
+
+  if (st->buf == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate memory (%zu bytes)", total);
+    st->kind = MESSAGE_NONE;
+  }
+}
+
+static void handle_data(struct mqtt_push_state *st,
+                        esp_mqtt_event_handle_t event) {
+  if (event->current_data_offset == 0) begin_message(st, event);
+  if (st->kind == MESSAGE_NONE) return;
+
+  // Fragments arrive in order; anything else means one was lost
+  if ((size_t)event->current_data_offset != st->len) {
+    ESP_LOGW(TAG, "Out of order fragment, dropping message");
+    drop_message(st);
+    return;
+  }
+  memcpy(st->buf + st->len, event->data, event->data_len);
+  st->len += event->data_len;
+  if (st->len < (size_t)event->total_data_len) return;
+
+  if (st->kind == MESSAGE_CONTROL) {
+    st->buf[st->len] = '\0';
+    st->on_control((const char *)st->buf, st->retained);
+    drop_message(st);
+  } else {
+    ESP_LOGD(TAG, "WebP received (%zu bytes)", st->len);
+    st->on_image(st->buf, st->len);  // Takes ownership
+    st->buf = NULL;
+    st->len = 0;
+    st->kind = MESSAGE_NONE;
+  }
+}
+
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
+                               int32_t event_id, void *event_data) {
+  struct mqtt_push_state *st = (struct mqtt_push_state *)handler_args;
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+  switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+      subscribe(st);
+      set_connected(true);
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+      drop_message(st);
+      set_connected(false);
+      ESP_LOGI(TAG, "Stack remaining: %u bytes",
+               uxTaskGetStackHighWaterMark(NULL));
+      break;
+    case MQTT_EVENT_DATA:
+      handle_data(st, event);
+      break;
+    case MQTT_EVENT_ERROR:
+      ESP_LOGE(TAG, "MQTT_EVENT_ERROR");
+      break;
+    default:
+      break;
+  }
+}
+
+int mqtt_push_start(const char *url, mqtt_push_control_cb_t on_control,
+                    mqtt_push_image_cb_t on_image) {
+  if (_state != NULL || !mqtt_push_is_url(url)) return 1;
+
+  struct mqtt_push_state *st = calloc(1, sizeof(*st));
+  if (st == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate MQTT state");
+    return 1;
+  }
+  if (parse_url(st, url) != 0) {
+    ESP_LOGE(TAG, "Invalid MQTT URL: %s", url);
+    free(st);
+    return 1;
+  }
+
+  uint8_t mac[6] = {0};
+  if (wifi_get_mac(mac) != 0) {
+    ESP_LOGW(TAG, "Failed to get MAC address for the device topic");
+  }
+  snprintf(st->device_id, sizeof(st->device_id), "%02x%02x%02x%02x%02x%02x",
+           mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  snprintf(st->status_topic, sizeof(st->status_topic), "%s/%s/status",
+           st->base, st->device_id);
+  st->on_control = on_control;
+  st->on_image = on_image;
+
+  char client_id[24];
+  snprintf(client_id, sizeof(client_id), "tronbyt-%s", st->device_id);
+  char api_key[MAX_API_KEY_LEN + 1] = {0};
+  bool has_userinfo = strchr(st->broker_uri, '@') != NULL;
+  if (!has_userinfo) nvs_get_api_key(api_key, sizeof(api_key));
+
+  esp_mqtt_client_config_t config = {
+      .broker.address.uri = st->broker_uri,
+      .broker.verification.crt_bundle_attach = esp_crt_bundle_attach,
+      .credentials.client_id = client_id,
+      .session.last_will =
+          {
+              .topic = st->status_topic,
+              .msg = "offline",
+              .qos = 1,
+              .retain = 1,
+          },
+      .network.reconnect_timeout_ms = 10000,
+      .buffer.size = MQTT_PUSH_BUFFER,
+      .task.stack_size = MQTT_PUSH_TASK_STACK,
+  };
+  if (api_key[0] != '\0') {
+    config.credentials.username = client_id;
+    config.credentials.authentication.password = api_key;
+  }
+
+  // The client copies the configuration strings
+  st->client = esp_mqtt_client_init(&config);
+  if (st->client == NULL) {
+    ESP_LOGE(TAG, "MQTT client initialization failed for URL: %s", url);
+    free(st);
+    return 1;
+  }
+  esp_mqtt_client_register_event(st->client, ESP_EVENT_ANY_ID,
+                                 mqtt_event_handler, st);
+  _state = st;
+
+  esp_err_t err = esp_mqtt_client_start(st->client);
+  if (err != ESP_OK) {
+    // The client retries on its own once its task runs; without it there
+    // is nothing to retry
+    ESP_LOGE(TAG, "Failed to start MQTT client: %s", esp_err_to_name(err));
+    return 1;
+  }
+  return 0;
+}
+
+bool mqtt_push_is_connected(void) { return _connected; }
+
+int mqtt_push_publish(const char *suffix, const uint8_t *data, size_t len) {
+  if (_state == NULL || !_connected) return 1;
+
+  char topic[MQTT_PUSH_TOPIC_LEN];
+  snprintf(topic, sizeof(topic), "%s/%s/%s", _state->base, _state->device_id,
+           suffix);
+  int msg_id = esp_mqtt_client_publish(_state->client, topic,
+                                       (const char *)data, len, 0, 0);
+  return msg_id < 0 ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Called with each control message (a NUL-terminated JSON object)
+ *
+ * retained is set when the broker replayed a retained message on connect.
+ * Runs on the MQTT task.
+ */
+typedef void (*mqtt_push_control_cb_t)(const char *json, bool retained);
+
+/**
+ * @brief Called with each complete image; the callee takes ownership and
+ *        gives it back with bufpool_release()
+ *
+ * Runs on the MQTT task.
+ */
+typedef void (*mqtt_push_image_cb_t)(uint8_t *image, size_t len);
+
+/**
+ * @brief Check whether url selects the MQTT transport
+ *
+ * @return true for mqtt:// and mqtts:// URLs
+ */
+bool mqtt_push_is_url(const char *url);
+
+/**
+ * @brief Connect to the broker in url and subscribe to the device's topics
+ *
+ * The URL is mqtt(s)://[user:pass@]host[:port]/<base>[?groups=a,b], with
+ * <base> defaulting to "tronbyt". The device subscribes to the "image" and
+ * "control" topics under <base>/<mac> and <base>/group/<group> for each
+ * group, where <mac> is the station MAC in lowercase hex without
+ * separators. "image" topics carry WebP payloads and "control" topics the
+ * same JSON as WebSocket text messages;
+ * publish them retained so a reconnecting device gets its state at once.
+ * Retained control messages are replayed on every connect, so one-shot
+ * commands (reboot, ota_url) in them are ignored.
+ * The device publishes "online" to <base>/<mac>/status (retained, with an
+ * "offline" last will). Without credentials in the URL, the API key is used
+ * as the password. Connection changes post APP_EVENT_PUSH_STATE.
+ *
+ * @return int 0 on success
+ */
+int mqtt_push_start(const char *url, mqtt_push_control_cb_t on_control,
+                    mqtt_push_image_cb_t on_image);
+
+/**
+ * @brief Check whether the broker connection is up
+ */
+bool mqtt_push_is_connected(void);
+
+/**
+ * @brief Publish data to <base>/<mac>/<suffix> (QoS 0, not retained)
+ *
+ * @return int 0 on success, 1 when not connected or the publish failed
+ */
+int mqtt_push_publish(const char *suffix, const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
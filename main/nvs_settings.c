@@ -28,6 +28,9 @@
 #define NVS_KEY_PREFER_IPV6 "prefer_ipv6"
 #define NVS_KEY_DISABLE_TOUCH "dis_touch"
 #define NVS_KEY_API_KEY "api_key"
+#define NVS_KEY_ROTATION "rotation"
+#define NVS_KEY_MIRROR "mirror"
+#define NVS_KEY_ZONE_LAYOUT "zone_layout"
 
 // Internal storage
 static char s_wifi_ssid[MAX_SSID_LEN + 1] = {0};
@@ -44,6 +47,9 @@ static bool s_ap_mode = true;
 static bool s_prefer_ipv6 = false;
 static bool s_disable_touch = false;
 static char s_api_key[MAX_API_KEY_LEN + 1] = {0};
+static uint8_t s_rotation = 0;  // Clockwise quarter turns
+static bool s_mirror = false;
+static uint8_t s_zone_layout = 0;
 
 // Hardcoded defaults (from secrets.json via generated secrets_gen.h)
 #include "secrets_gen.h"
@@ -169,6 +175,18 @@ esp_err_t nvs_settings_init(void) {
       s_disable_touch = (val_u8 != 0);
     }
 
+    if (nvs_get_u8(nvs_handle, NVS_KEY_ROTATION, &val_u8) == ESP_OK) {
+      s_rotation = val_u8 & 3;
+    }
+
+    if (nvs_get_u8(nvs_handle, NVS_KEY_MIRROR, &val_u8) == ESP_OK) {
+      s_mirror = (val_u8 != 0);
+    }
+
+    if (nvs_get_u8(nvs_handle, NVS_KEY_ZONE_LAYOUT, &val_u8) == ESP_OK) {
+      s_zone_layout = val_u8;
+    }
+
     required_size = sizeof(s_api_key);
     if (nvs_get_str(nvs_handle, NVS_KEY_API_KEY, s_api_key,
                     &required_size) != ESP_OK) {
@@ -270,6 +288,12 @@ bool nvs_get_prefer_ipv6(void) { return s_prefer_ipv6; }
 
 bool nvs_get_disable_touch(void) { return s_disable_touch; }
 
+uint16_t nvs_get_rotation(void) { return s_rotation * 90; }
+
+bool nvs_get_mirror(void) { return s_mirror; }
+
+uint8_t nvs_get_zone_layout(void) { return s_zone_layout; }
+
 esp_err_t nvs_get_api_key(char *api_key, size_t max_len) {
   if (!api_key) return ESP_ERR_INVALID_ARG;
   strncpy(api_key, s_api_key, max_len);
@@ -405,6 +429,22 @@ esp_err_t nvs_set_disable_touch(bool disable_touch) {
   return ESP_OK;
 }
 
+esp_err_t nvs_set_rotation(uint16_t degrees) {
+  if (degrees % 90 != 0 || degrees >= 360) return ESP_ERR_INVALID_ARG;
+  s_rotation = degrees / 90;
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_mirror(bool mirror) {
+  s_mirror = mirror;
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_zone_layout(uint8_t layout) {
+  s_zone_layout = layout;
+  return ESP_OK;
+}
+
 esp_err_t nvs_save_settings(void) {
   nvs_handle_t nvs_handle;
   esp_err_t err;
@@ -427,6 +467,9 @@ esp_err_t nvs_save_settings(void) {
   nvs_set_u8(nvs_handle, NVS_KEY_AP_MODE, s_ap_mode ? 1 : 0);
   nvs_set_u8(nvs_handle, NVS_KEY_PREFER_IPV6, s_prefer_ipv6 ? 1 : 0);
   nvs_set_u8(nvs_handle, NVS_KEY_DISABLE_TOUCH, s_disable_touch ? 1 : 0);
+  nvs_set_u8(nvs_handle, NVS_KEY_ROTATION, s_rotation);
+  nvs_set_u8(nvs_handle, NVS_KEY_MIRROR, s_mirror ? 1 : 0);
+  nvs_set_u8(nvs_handle, NVS_KEY_ZONE_LAYOUT, s_zone_layout);
 
   err = nvs_commit(nvs_handle);
   nvs_close(nvs_handle);
@@ -38,6 +38,9 @@ bool nvs_get_skip_boot_animation(void);
 bool nvs_get_ap_mode(void);
 bool nvs_get_prefer_ipv6(void);
 bool nvs_get_disable_touch(void);
+uint16_t nvs_get_rotation(void);  // Degrees clockwise: 0, 90, 180 or 270
+bool nvs_get_mirror(void);
+uint8_t nvs_get_zone_layout(void);  // GFX_ZONES_* from gfx.h
 
 // Setters
 esp_err_t nvs_set_ssid(const char *ssid);
@@ -54,6 +57,9 @@ esp_err_t nvs_set_skip_boot_animation(bool skip);
 esp_err_t nvs_set_ap_mode(bool ap_mode);
 esp_err_t nvs_set_prefer_ipv6(bool prefer_ipv6);
 esp_err_t nvs_set_disable_touch(bool disable_touch);
+esp_err_t nvs_set_rotation(uint16_t degrees);
+esp_err_t nvs_set_mirror(bool mirror);
+esp_err_t nvs_set_zone_layout(uint8_t layout);
 
 // Save all modified settings to NVS
 esp_err_t nvs_save_settings(void);
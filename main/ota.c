@@ -219,6 +219,15 @@ static bool validate_and_rewrite_url(const char *url, char *out_url,
   return true;
 }
 
+static void show_message(const char *text, uint8_t r, uint8_t g, uint8_t b) {
+  display_overlay_clear(DISPLAY_OVERLAY_OTA_TRACK);
+  display_overlay_clear(DISPLAY_OVERLAY_OTA_BAR);
+  display_frame_begin();
+  display_clear();
+  display_text(text, 2, 10, r, g, b, 1);
+  display_frame_commit();
+}
+
 void run_ota(const char *url) {
   char final_url[512] = {0};
   if (!validate_and_rewrite_url(url, final_url, sizeof(final_url))) {
@@ -244,28 +253,13 @@ void run_ota(const char *url) {
   gfx_stop();
   vTaskDelay(pdMS_TO_TICKS(100));  // Short grace period
 
-  // Initialize display for OTA progress
-  // We need to initialize BOTH buffers to ensure no "bleed through" of previous
-  // content when flipping buffers during the OTA process.
-
-  // Frame 1 (Back Buffer -> Front)
-  display_clear();
-  display_text("OTA Update", 2, 10, 0, 0, 255, 1);
-  display_flip();
-
-  // Frame 2 (Current Back Buffer)
-  display_clear();
-  display_text("OTA Update", 2, 10, 0, 0, 255, 1);
-  // Don't flip here, we want to draw the progress bar on top of this background
-  // in the loop
+  show_message("OTA Update", 0, 0, 255);
 
   esp_https_ota_handle_t https_ota_handle = NULL;
   esp_err_t err = esp_https_ota_begin(&ota_config, &https_ota_handle);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "ESP HTTPS OTA Begin failed: %s", esp_err_to_name(err));
-    display_clear();
-    display_text("OTA Fail", 2, 10, 255, 0, 0, 1);
-    display_flip();
+    show_message("OTA Fail", 255, 0, 0);
     vTaskDelay(pdMS_TO_TICKS(2000));
     gfx_start();
     return;
@@ -290,13 +284,11 @@ void run_ota(const char *url) {
       int progress_width = (cur_len * bar_w) / total_len;
 
       if (progress_width != last_progress_width) {
-        // Draw background (dim)
-        display_fill_rect(bar_x, bar_y, bar_w, bar_h, 10, 10, 10);
-        // Draw progress (green)
-        if (progress_width > 0) {
-          display_fill_rect(bar_x, bar_y, progress_width, bar_h, 0, 255, 0);
-        }
-        display_flip();
+        // Overlay sprites; the paused gfx task composites and flips them
+        display_overlay_set(DISPLAY_OVERLAY_OTA_TRACK, bar_x, bar_y, bar_w,
+                            bar_h, 10, 10, 10);
+        display_overlay_set(DISPLAY_OVERLAY_OTA_BAR, bar_x, bar_y,
+                            progress_width, bar_h, 0, 255, 0);
         last_progress_width = progress_width;
       }
     }
@@ -308,25 +300,19 @@ void run_ota(const char *url) {
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "OTA Update failed: %s", esp_err_to_name(err));
     esp_https_ota_finish(https_ota_handle);
-    display_clear();
-    display_text("OTA Fail", 2, 10, 255, 0, 0, 1);
-    display_flip();
+    show_message("OTA Fail", 255, 0, 0);
     vTaskDelay(pdMS_TO_TICKS(2000));
     gfx_start();
   } else {
     err = esp_https_ota_finish(https_ota_handle);
     if (err == ESP_OK) {
       ESP_LOGI(TAG, "OTA Update successful. Rebooting...");
-      display_clear();
-      display_text("Rebooting", 2, 10, 0, 255, 0, 1);
-      display_flip();
+      show_message("Rebooting", 0, 255, 0);
       vTaskDelay(pdMS_TO_TICKS(1000));
       esp_restart();
     } else {
       ESP_LOGE(TAG, "OTA Finish failed: %s", esp_err_to_name(err));
-      display_clear();
-      display_text("OTA Fail", 2, 10, 255, 0, 0, 1);
-      display_flip();
+      show_message("OTA Fail", 255, 0, 0);
       vTaskDelay(pdMS_TO_TICKS(2000));
       gfx_start();
     }
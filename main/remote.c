@@ -3,19 +3,35 @@
 #include <esp_http_client.h>
 #include <esp_log.h>
 #include <esp_netif.h>
+#include <esp_rom_crc.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <esp_tls.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "bufpool.h"
+#include "bundle.h"
 #include "gfx.h"
 #include "nvs_settings.h"
+#include "remote.h"
 #include "sdkconfig.h"
 #include "version.h"
 
 static const char* TAG = "remote";
 
+#define REMOTE_ETAG_LEN 96
+#define REMOTE_DATE_LEN 40  // "Sun, 06 Nov 1994 08:49:37 GMT"
+
+// Longest wait the device asks a long-polling server to hold a request for;
+// the client timeout is stretched by the margin on top of it.
+#define REMOTE_LONG_POLL_MAX_SECS 120
+#define REMOTE_LONG_POLL_MARGIN_MS 10000
+#define REMOTE_TIMEOUT_MS 20000
+
 struct remote_state {
   void* buf;
   size_t len;
@@ -27,7 +43,65 @@ struct remote_state {
   char* image_url;
   bool reboot_requested;
   bool oversize_detected;
+  // Timestamps (esp_timer) for the request timing breakdown
+  int64_t start_us;
+  int64_t connected_us;  // 0 if an existing connection was reused
+  int64_t first_header_us;
+  // Cache validators from the response, stored once it completes with 200
+  char etag[REMOTE_ETAG_LEN];
+  char last_modified[REMOTE_DATE_LEN];
+  // Scheduling hints, -1 / 0 when the response has none
+  int32_t max_age_secs;
+  int32_t retry_after_secs;
+  uint32_t long_poll_secs;
+  // Whole body size, 0 if unknown (chunked)
+  size_t total;
+  // Content-Range of a 206 response, -1 if none
+  int64_t range_start;
+  int64_t range_total;
+  bool ranges_refused;  // Accept-Ranges: none
+};
+
+// Validators for conditional GETs, remembered for the last few URLs so a
+// device alternating between image URLs still gets 304s.
+#define REMOTE_VALIDATOR_SLOTS 4
+struct remote_validator {
+  char url[MAX_URL_LEN + 1];
+  char etag[REMOTE_ETAG_LEN];
+  char last_modified[REMOTE_DATE_LEN];
+  uint32_t body_crc;  // CRC32 of the last body, sent as the long-poll hash
+  uint32_t last_used;
+};
+static struct remote_validator s_validators[REMOTE_VALIDATOR_SLOTS];
+static uint32_t s_validator_clock;
+
+// A body that broke off mid-transfer, kept so the next request for the same
+// URL only asks for the rest. A single slot, since each holds an image-sized
+// buffer.
+#define REMOTE_RESUME_BACKOFF_MIN_SECS 2
+#define REMOTE_RESUME_BACKOFF_MAX_SECS 60
+// Attempts in a row without new bytes before the partial body is dropped
+#define REMOTE_RESUME_MAX_STALLS 6
+struct remote_partial {
+  char url[MAX_URL_LEN + 1];
+  char etag[REMOTE_ETAG_LEN];  // Strong ETag, or empty to use last_modified
+  char last_modified[REMOTE_DATE_LEN];
+  void* buf;  // NULL when nothing is kept
+  size_t len;
+  size_t size;
+  size_t total;
+  int stalls;  // Consecutive attempts that added nothing
 };
+static struct remote_partial s_partial;
+static remote_download_stats_t s_download_stats;
+
+// One client for the polling loop, kept across calls so the TCP connection
+// (HTTP keep-alive) and the TLS session ticket can be reused. Only ever
+// touched from the task that calls remote_get().
+static esp_http_client_handle_t s_http = NULL;
+static bool s_http_warm = false;  // s_http has completed a request
+static remote_timing_t s_last_timing;
+static remote_poll_hint_t s_poll_hint = {-1, -1, 0};
 
 static bool parse_header_bool(const char* value) {
   if (value == NULL || value[0] == '\0') {
@@ -37,9 +111,48 @@ static bool parse_header_bool(const char* value) {
          strcasecmp(value, "yes") == 0;
 }
 
-#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+// Parses a non-negative number of seconds, or returns -1 (e.g. for the
+// HTTP-date form of Retry-After, which is not supported).
+static int32_t parse_header_secs(const char* value) {
+  if (value == NULL || value[0] < '0' || value[0] > '9') return -1;
+  long secs = strtol(value, NULL, 10);
+  return secs > INT32_MAX ? INT32_MAX : (int32_t)secs;
+}
+
+// Picks max-age out of a Cache-Control header; no-cache and no-store mean
+// there is no freshness to wait out.
+static int32_t parse_cache_control_max_age(const char* value) {
+  int32_t max_age = -1;
+  for (const char* p = value; p != NULL && *p != '\0';) {
+    while (*p == ' ' || *p == ',') p++;
+    if (strncasecmp(p, "no-cache", 8) == 0 ||
+        strncasecmp(p, "no-store", 8) == 0) {
+      return -1;
+    }
+    if (strncasecmp(p, "max-age=", 8) == 0) {
+      max_age = parse_header_secs(p + 8);
+    }
+    p = strchr(p, ',');
+  }
+  return max_age;
+}
+
+// Parses "bytes <first>-<last>/<total>"; anything else (such as an unknown
+// total) leaves start and total untouched.
+static void parse_content_range(const char* value, int64_t* start,
+                                int64_t* total) {
+  long long first, last, length;
+  if (sscanf(value, "bytes %lld-%lld/%lld", &first, &last, &length) == 3 &&
+      first <= last && last < length) {
+    *start = first;
+    *total = length;
+  }
+}
+
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
+#define REMOTE_MAX_REDIRECTS 5
+
 static esp_err_t _httpCallback(esp_http_client_event_t* event) {
   esp_err_t err = ESP_OK;
   struct remote_state* state = (struct remote_state*)event->user_data;
@@ -51,6 +164,7 @@ static esp_err_t _httpCallback(esp_http_client_event_t* event) {
 
     case HTTP_EVENT_ON_CONNECTED:
       ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED");
+      state->connected_us = esp_timer_get_time();
       break;
 
     case HTTP_EVENT_HEADER_SENT:
@@ -60,6 +174,9 @@ static esp_err_t _httpCallback(esp_http_client_event_t* event) {
     case HTTP_EVENT_ON_HEADER:
       ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", event->header_key,
                event->header_value);
+      if (state->first_header_us == 0) {
+        state->first_header_us = esp_timer_get_time();
+      }
 
       // Check for the Content-Length header
       if (strcasecmp(event->header_key, "Content-Length") == 0) {
@@ -68,13 +185,9 @@ static esp_err_t _httpCallback(esp_http_client_event_t* event) {
           ESP_LOGE(TAG,
                    "Content-Length (%d bytes) exceeds allowed max (%d bytes)",
                    content_length, state->max);
-          // Display the oversize graphic
-          if (gfx_display_asset("oversize") != 0) {
-            ESP_LOGE(TAG, "Failed to display oversize graphic");
-          }
+          // remote_get() shows the oversize graphic and drops the
+          // connection once the headers are in
           state->oversize_detected = true;
-          err = ESP_ERR_NO_MEM;
-          esp_http_client_close(event->client);  // Abort the HTTP request
         } else {
           ESP_LOGI(TAG, "Content-Length Header : %d", content_length);
         }
@@ -96,6 +209,24 @@ static esp_err_t _httpCallback(esp_http_client_event_t* event) {
         if (state->image_url != NULL) free(state->image_url);
         state->image_url = strdup(event->header_value);
         ESP_LOGI(TAG, "Found Image URL: %s", state->image_url);
+      } else if (strcasecmp(event->header_key, "ETag") == 0) {
+        strlcpy(state->etag, event->header_value, sizeof(state->etag));
+      } else if (strcasecmp(event->header_key, "Last-Modified") == 0) {
+        strlcpy(state->last_modified, event->header_value,
+                sizeof(state->last_modified));
+      } else if (strcasecmp(event->header_key, "Content-Range") == 0) {
+        parse_content_range(event->header_value, &state->range_start,
+                            &state->range_total);
+      } else if (strcasecmp(event->header_key, "Accept-Ranges") == 0) {
+        state->ranges_refused = strcasecmp(event->header_value, "none") == 0;
+      } else if (strcasecmp(event->header_key, "Cache-Control") == 0) {
+        state->max_age_secs = parse_cache_control_max_age(event->header_value);
+      } else if (strcasecmp(event->header_key, "Retry-After") == 0) {
+        state->retry_after_secs = parse_header_secs(event->header_value);
+      } else if (strcasecmp(event->header_key, "Tronbyt-Long-Poll") == 0) {
+        int32_t secs = parse_header_secs(event->header_value);
+        state->long_poll_secs =
+            secs > 0 ? MIN((uint32_t)secs, REMOTE_LONG_POLL_MAX_SECS) : 0;
       } else if (strcasecmp(event->header_key, "Tronbyt-Reboot") == 0) {
         state->reboot_requested = parse_header_bool(event->header_value);
         ESP_LOGI(TAG, "Tronbyt-Reboot value: %s", event->header_value);
@@ -103,65 +234,8 @@ static esp_err_t _httpCallback(esp_http_client_event_t* event) {
       break;
 
     case HTTP_EVENT_ON_DATA:
-
-      if (event->user_data == NULL) {
-        ESP_LOGW(TAG, "Discarding HTTP response due to missing state");
-        break;
-      }
-
-      // If oversize was detected, don't process any data
-      if (state->oversize_detected) {
-        ESP_LOGD(TAG, "Discarding HTTP data due to oversize detection");
-        break;
-      }
-
-      // If buffer was freed, don't process any data
-      if (state->buf == NULL) {
-        ESP_LOGD(TAG, "Discarding HTTP data due to freed buffer");
-        break;
-      }
-
-      // if (event->data_len > max_data_size) {
-      //   ESP_LOGW(TAG, "Discarding HTTP response due to missing state");
-      //   break;
-      // }
-
-      // If needed, resize the buffer to fit the new data
-      if (event->data_len + state->len > state->size) {
-        // Determine new size
-        state->size =
-            MAX(MIN(state->size * 2, state->max), state->len + event->data_len);
-        if (state->size > state->max) {
-          ESP_LOGE(TAG, "Response size exceeds allowed max (%d bytes)",
-                   state->max);
-          // Display the oversize graphic
-          if (gfx_display_asset("oversize") != 0) {
-            ESP_LOGE(TAG, "Failed to display oversize graphic");
-          }
-          free(state->buf);
-          state->buf = NULL;
-          state->oversize_detected = true;
-          err = ESP_ERR_NO_MEM;
-          esp_http_client_close(event->client);  // Abort the HTTP request
-          break;
-        }
-
-        // And reallocate
-        void* new =
-            heap_caps_realloc(state->buf, state->size, MALLOC_CAP_SPIRAM);
-        if (new == NULL) {
-          ESP_LOGE(TAG, "Resizing response buffer failed");
-          free(state->buf);
-          state->buf = NULL;
-          err = ESP_ERR_NO_MEM;
-          break;
-        }
-        state->buf = new;
-      }
-
-      // Copy over the new data
-      memcpy(state->buf + state->len, event->data, event->data_len);
-      state->len += event->data_len;
+      // The body is read directly into the response buffer by
+      // remote_read_body(); nothing to copy here
       break;
 
     case HTTP_EVENT_ON_FINISH:
@@ -181,24 +255,309 @@ static esp_err_t _httpCallback(esp_http_client_event_t* event) {
       break;
 
     case HTTP_EVENT_REDIRECT:
+      // Only raised by esp_http_client_perform(); remote_open() follows
+      // redirects itself
       ESP_LOGD(TAG, "HTTP_EVENT_REDIRECT");
-      esp_http_client_set_redirection(event->client);
       break;
   }
 
   return err;
 }
 
+static struct remote_validator* validator_find(const char* url) {
+  for (int i = 0; i < REMOTE_VALIDATOR_SLOTS; i++) {
+    if (strcmp(s_validators[i].url, url) == 0) return &s_validators[i];
+  }
+  return NULL;
+}
+
+static void validator_forget(const char* url) {
+  struct remote_validator* v = validator_find(url);
+  if (v != NULL) memset(v, 0, sizeof(*v));
+}
+
+void remote_forget_validator(const char* url) { validator_forget(url); }
+
+static void validator_store(const char* url, const struct remote_state* state) {
+  if (strlen(url) > MAX_URL_LEN) return;
+
+  struct remote_validator* v = validator_find(url);
+  if (v == NULL) {
+    // Reuse the least recently used slot
+    v = &s_validators[0];
+    for (int i = 1; i < REMOTE_VALIDATOR_SLOTS; i++) {
+      if (s_validators[i].last_used < v->last_used) v = &s_validators[i];
+    }
+    strlcpy(v->url, url, sizeof(v->url));
+  }
+  strlcpy(v->etag, state->etag, sizeof(v->etag));
+  strlcpy(v->last_modified, state->last_modified, sizeof(v->last_modified));
+  v->body_crc = esp_rom_crc32_le(0, state->buf, state->len);
+  v->last_used = ++s_validator_clock;
+}
+
+// Adds If-None-Match / If-Modified-Since for url, or removes them from the
+// reused client when nothing is known about it.
+static void validator_apply(esp_http_client_handle_t http, const char* url) {
+  struct remote_validator* v = validator_find(url);
+  if (v != NULL && v->etag[0] != '\0') {
+    esp_http_client_set_header(http, "If-None-Match", v->etag);
+  } else {
+    esp_http_client_delete_header(http, "If-None-Match");
+  }
+  if (v != NULL && v->last_modified[0] != '\0') {
+    esp_http_client_set_header(http, "If-Modified-Since", v->last_modified);
+  } else {
+    esp_http_client_delete_header(http, "If-Modified-Since");
+  }
+  if (v != NULL) v->last_used = ++s_validator_clock;
+}
+
+// Builds the long-poll form of url into out: the hash of what the device
+// already has and how long the server may hold the request. Returns false
+// (out untouched) unless the server has offered long-polling and url has
+// been fetched before.
+static bool long_poll_url(const char* url, char* out, size_t out_len) {
+  struct remote_validator* v = validator_find(url);
+  if (s_poll_hint.long_poll_secs == 0 || v == NULL) return false;
+
+  int n = snprintf(out, out_len, "%s%chash=%08" PRIx32 "&wait=%" PRIu32, url,
+                   strchr(url, '?') != NULL ? '&' : '?', v->body_crc,
+                   s_poll_hint.long_poll_secs);
+  return n > 0 && (size_t)n < out_len;
+}
+
+static void log_download_stats(void) {
+  const remote_download_stats_t* s = &s_download_stats;
+  ESP_LOGI(TAG,
+           "Downloads: %" PRIu32 " of %" PRIu32 " completed (%" PRIu32
+           "%%), %" PRIu32 " resumes saved %" PRIu64 " bytes",
+           s->completed, s->started,
+           s->started > 0 ? s->completed * 100 / s->started : 0, s->resumes,
+           s->resumed_bytes);
+}
+
+// Keeps the body of a download that broke off so it can be resumed.
+// resumed_from is how much the attempt started with and stalls how many
+// attempts before it added nothing. Returns the seconds to wait before
+// resuming, or -1 if the body cannot be resumed (the caller still owns it).
+static int32_t partial_keep(const char* url, const struct remote_state* state,
+                            size_t resumed_from, int stalls) {
+  // If-Range needs a strong ETag or a date
+  bool strong_etag =
+      state->etag[0] != '\0' && strncmp(state->etag, "W/", 2) != 0;
+  if (state->total == 0 || state->len == 0 || state->len >= state->total ||
+      state->ranges_refused ||
+      (!strong_etag && state->last_modified[0] == '\0') ||
+      strlen(url) > MAX_URL_LEN) {
+    return -1;
+  }
+
+  stalls = state->len > resumed_from ? 0 : stalls + 1;
+  if (stalls >= REMOTE_RESUME_MAX_STALLS) {
+    ESP_LOGW(TAG, "Giving up on resuming %s after %d attempts", url, stalls);
+    log_download_stats();
+    return -1;
+  }
+
+  strlcpy(s_partial.url, url, sizeof(s_partial.url));
+  strlcpy(s_partial.etag, strong_etag ? state->etag : "",
+          sizeof(s_partial.etag));
+  strlcpy(s_partial.last_modified, state->last_modified,
+          sizeof(s_partial.last_modified));
+  s_partial.buf = state->buf;
+  s_partial.len = state->len;
+  s_partial.size = state->size;
+  s_partial.total = state->total;
+  s_partial.stalls = stalls;
+
+  // Attempts that get somewhere are retried soon; ones that don't back off
+  int32_t backoff_secs = REMOTE_RESUME_BACKOFF_MIN_SECS << stalls;
+  backoff_secs = MIN(backoff_secs, REMOTE_RESUME_BACKOFF_MAX_SECS);
+  ESP_LOGI(TAG, "Keeping %zu of %zu bytes, resuming in %" PRId32 " s",
+           state->len, state->total, backoff_secs);
+  return backoff_secs;
+}
+
+static void partial_discard(void) {
+  if (s_partial.buf == NULL) return;
+  ESP_LOGI(TAG, "Dropping partial download of %s (%zu of %zu bytes)",
+           s_partial.url, s_partial.len, s_partial.total);
+  bufpool_release(s_partial.buf);
+  memset(&s_partial, 0, sizeof(s_partial));
+}
+
+static void remote_client_reset(void) {
+  if (s_http != NULL) {
+    esp_http_client_cleanup(s_http);
+    s_http = NULL;
+  }
+  s_http_warm = false;
+}
+
+// Returns the persistent client pointed at url, creating it on first use or
+// after an error. esp_http_client_set_url() keeps the open connection when
+// the host and port are unchanged.
+static esp_http_client_handle_t remote_client(const char* url,
+                                              struct remote_state* state) {
+  if (s_http != NULL) {
+    if (esp_http_client_set_url(s_http, url) == ESP_OK &&
+        esp_http_client_set_user_data(s_http, state) == ESP_OK) {
+      return s_http;
+    }
+    ESP_LOGW(TAG, "Could not reuse HTTP client, recreating it");
+    remote_client_reset();
+  }
+
+  esp_http_client_config_t config = {
+      .url = url,
+      .event_handler = _httpCallback,
+      .user_data = state,
+      .timeout_ms = REMOTE_TIMEOUT_MS,  // Increased from 10s to 20s
+      .crt_bundle_attach = esp_crt_bundle_attach,
+      .keep_alive_enable = true,
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+      .save_client_session = true,
+#endif
+  };
+
+  s_http = esp_http_client_init(&config);
+  if (s_http == NULL) {
+    ESP_LOGE(TAG, "HTTP client initialization failed for URL: %s", url);
+  }
+  return s_http;
+}
+
+static void record_timing(const struct remote_state* state) {
+  int64_t end_us = esp_timer_get_time();
+  remote_timing_t* t = &s_last_timing;
+  t->reused = state->connected_us == 0;
+  t->connect_us = t->reused ? 0 : state->connected_us - state->start_us;
+  if (state->first_header_us != 0) {
+    int64_t sent_us = t->reused ? state->start_us : state->connected_us;
+    t->ttfb_us = state->first_header_us - sent_us;
+    t->transfer_us = end_us - state->first_header_us;
+  } else {
+    t->ttfb_us = 0;
+    t->transfer_us = 0;
+  }
+  t->bytes = state->len;
+
+  ESP_LOGI(TAG,
+           "Fetch timing: connect %" PRId64 " ms%s, ttfb %" PRId64
+           " ms, transfer %" PRId64 " ms (%zu bytes)",
+           t->connect_us / 1000, t->reused ? " (reused)" : "",
+           t->ttfb_us / 1000, t->transfer_us / 1000, t->bytes);
+}
+
+void remote_get_last_timing(remote_timing_t* timing) {
+  *timing = s_last_timing;
+}
+
+void remote_get_poll_hint(remote_poll_hint_t* hint) { *hint = s_poll_hint; }
+
+void remote_get_download_stats(remote_download_stats_t* stats) {
+  *stats = s_download_stats;
+}
+
+static bool is_redirect(int status_code) {
+  return status_code == 301 || status_code == 302 || status_code == 303 ||
+         status_code == 307 || status_code == 308;
+}
+
+// Sends the request and reads the response headers, following redirects.
+// Returns the Content-Length, or -1 if the response is chunked, has none or
+// the request failed (err is set).
+static int64_t remote_open(esp_http_client_handle_t http, esp_err_t* err) {
+  for (int redirects = 0;; redirects++) {
+    *err = esp_http_client_open(http, 0);
+    if (*err != ESP_OK) return -1;
+
+    int64_t content_length = esp_http_client_fetch_headers(http);
+    if (content_length < 0) {
+      *err = ESP_FAIL;
+      return -1;
+    }
+
+    int status_code = esp_http_client_get_status_code(http);
+    if (!is_redirect(status_code) || redirects >= REMOTE_MAX_REDIRECTS) {
+      // fetch_headers() reports 0 for chunked bodies
+      return esp_http_client_is_chunked_response(http) ? -1 : content_length;
+    }
+
+    // Drain the redirect body so the connection can be reused, then go again
+    esp_http_client_flush_response(http, NULL);
+    *err = esp_http_client_set_redirection(http);
+    if (*err != ESP_OK) return -1;
+    ESP_LOGD(TAG, "Following redirect (%d)", status_code);
+  }
+}
+
+// Reads the body straight into the response buffer. With a Content-Length
+// the buffer is allocated at its final size up front (a pool buffer already
+// is); chunked bodies grow a heap buffer geometrically up to the max. A
+// resumed body is appended to the buffer already in state.
+static esp_err_t remote_read_body(esp_http_client_handle_t http,
+                                  struct remote_state* state,
+                                  int64_t content_length) {
+  if (state->buf == NULL) {
+    state->buf = bufpool_acquire(&state->size);
+  }
+  if (state->buf == NULL) {
+    state->size = content_length > 0 ? (size_t)content_length
+                                     : CONFIG_HTTP_BUFFER_SIZE_DEFAULT;
+    state->buf = heap_caps_malloc(state->size, MALLOC_CAP_SPIRAM);
+  }
+  if (state->buf == NULL) {
+    ESP_LOGE(TAG, "couldn't allocate HTTP receive buffer");
+    return ESP_ERR_NO_MEM;
+  }
+
+  for (;;) {
+    if (state->len == state->size) {
+      if (esp_http_client_is_complete_data_received(http)) break;
+      if (state->size >= state->max) {
+        ESP_LOGE(TAG, "Response size exceeds allowed max (%d bytes)",
+                 state->max);
+        state->oversize_detected = true;
+        return ESP_ERR_NO_MEM;
+      }
+      // Pool buffers are already at the max, so only heap buffers grow
+      size_t new_size = MIN(state->size * 2, state->max);
+      void* new = heap_caps_realloc(state->buf, new_size, MALLOC_CAP_SPIRAM);
+      if (new == NULL) {
+        ESP_LOGE(TAG, "Resizing response buffer failed");
+        return ESP_ERR_NO_MEM;
+      }
+      state->buf = new;
+      state->size = new_size;
+    }
+
+    int n = esp_http_client_read(http, (char*)state->buf + state->len,
+                                 state->size - state->len);
+    if (n < 0) {
+      ESP_LOGE(TAG, "Reading response body failed (%d)", n);
+      return ESP_FAIL;
+    }
+    if (n == 0) {
+      if (esp_http_client_is_complete_data_received(http)) break;
+      ESP_LOGE(TAG, "Connection closed after %zu bytes", state->len);
+      return ESP_FAIL;
+    }
+    state->len += n;
+  }
+  return ESP_OK;
+}
+
 int remote_get(const char* url, uint8_t** buf, size_t* len,
                uint8_t* brightness_pct, int32_t* dwell_secs,
                int* return_status_code, char** ota_url, char** image_url,
                bool* reboot_requested) {
   // State for processing the response
   struct remote_state state = {
-      .buf =
-          heap_caps_malloc(CONFIG_HTTP_BUFFER_SIZE_DEFAULT, MALLOC_CAP_SPIRAM),
+      .buf = NULL,
       .len = 0,
-      .size = CONFIG_HTTP_BUFFER_SIZE_DEFAULT,
+      .size = 0,
       .max = CONFIG_HTTP_BUFFER_SIZE_MAX,
       .brightness = -1,
       .dwell_secs = -1,
@@ -206,28 +565,43 @@ int remote_get(const char* url, uint8_t** buf, size_t* len,
       .image_url = NULL,
       .reboot_requested = false,
       .oversize_detected = false,
+      .max_age_secs = -1,
+      .retry_after_secs = -1,
+      .long_poll_secs = 0,
+      .total = 0,
+      .range_start = -1,
+      .range_total = -1,
+      .ranges_refused = false,
   };
 
-  if (state.buf == NULL) {
-    ESP_LOGE(TAG, "couldn't allocate HTTP receive buffer");
-    return 1;
+  // Take over a partial body of url; one for another url is stale
+  struct remote_partial resume = {0};
+  if (s_partial.buf != NULL && strcmp(s_partial.url, url) == 0) {
+    resume = s_partial;
+    memset(&s_partial, 0, sizeof(s_partial));
+    // A 206 without validators still describes the same body
+    strlcpy(state.etag, resume.etag, sizeof(state.etag));
+    strlcpy(state.last_modified, resume.last_modified,
+            sizeof(state.last_modified));
+  } else {
+    partial_discard();
   }
 
-  // Set up http client
-  esp_http_client_config_t config = {
-      .url = url,
-      .event_handler = _httpCallback,
-      .user_data = &state,
-      .timeout_ms = 20e3,  // Increased from 10s to 20s
-      .crt_bundle_attach = esp_crt_bundle_attach,
-  };
-
-  esp_http_client_handle_t http = esp_http_client_init(&config);
+  // Validators and hints stay keyed by the plain url; only the request
+  // carries the long-poll parameters. A resume is never held by the server.
+  char poll_url[MAX_URL_LEN + 48];
+  bool long_poll =
+      resume.buf == NULL && long_poll_url(url, poll_url, sizeof(poll_url));
+  esp_http_client_handle_t http =
+      remote_client(long_poll ? poll_url : url, &state);
   if (http == NULL) {
-    ESP_LOGE(TAG, "HTTP client initialization failed for URL: %s", url);
-    free(state.buf);
+    s_partial = resume;
     return 1;
   }
+  esp_http_client_set_timeout_ms(
+      http, long_poll ? s_poll_hint.long_poll_secs * 1000 +
+                            REMOTE_LONG_POLL_MARGIN_MS
+                      : REMOTE_TIMEOUT_MS);
 
   if (esp_http_client_set_header(http, "X-Firmware-Version",
                                  FIRMWARE_VERSION) != ESP_OK) {
@@ -244,57 +618,163 @@ int remote_get(const char* url, uint8_t** buf, size_t* len,
         ESP_OK) {
       ESP_LOGE(TAG, "Failed to set Authorization header");
     }
+  } else {
+    // The client is reused, so drop a key that has since been cleared
+    esp_http_client_delete_header(http, "Authorization");
+  }
+
+  validator_apply(http, url);
+  if (resume.buf != NULL) {
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%zu-", resume.len);
+    esp_http_client_set_header(http, "Range", range);
+    // Without a match the server sends the whole new body instead
+    esp_http_client_set_header(
+        http, "If-Range",
+        resume.etag[0] != '\0' ? resume.etag : resume.last_modified);
+    ESP_LOGI(TAG, "Resuming download at %zu of %zu bytes", resume.len,
+             resume.total);
+  } else {
+    esp_http_client_delete_header(http, "Range");
+    esp_http_client_delete_header(http, "If-Range");
   }
 
   // Do the request
-  esp_err_t err = esp_http_client_perform(http);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "couldn't reach %s: %s", url, esp_err_to_name(err));
-    if (state.buf != NULL) {
-      free(state.buf);
+  state.start_us = esp_timer_get_time();
+  esp_err_t err;
+  int64_t content_length = remote_open(http, &err);
+  if (err != ESP_OK && s_http_warm && state.connected_us == 0 &&
+      state.first_header_us == 0) {
+    // The server may have dropped the idle keep-alive connection between
+    // polls; retry once on a fresh one before reporting a failure.
+    ESP_LOGW(TAG, "Reused connection failed (%s), reconnecting",
+             esp_err_to_name(err));
+    esp_http_client_close(http);
+    state.start_us = esp_timer_get_time();
+    content_length = remote_open(http, &err);
+  }
+
+  int status_code = err == ESP_OK ? esp_http_client_get_status_code(http) : 0;
+  if (err == ESP_OK && !state.oversize_detected) {
+    bool resumed = resume.buf != NULL && status_code == 206 &&
+                   state.range_start == (int64_t)resume.len &&
+                   state.range_total == (int64_t)resume.total;
+    if (resumed) {
+      // Carry on where the last attempt broke off; to the caller this is
+      // the whole body
+      state.buf = resume.buf;
+      state.len = resume.len;
+      state.size = resume.size;
+      state.total = resume.total;
+      resume.buf = NULL;
+      status_code = 200;
+      s_download_stats.resumes++;
+      s_download_stats.resumed_bytes += state.len;
+    } else if (resume.buf != NULL) {
+      // The content changed (If-Range did not match) or the server ignored
+      // the range; free the old body before receiving a new one
+      ESP_LOGI(TAG, "Not resumable (HTTP %d), dropping %zu bytes",
+               status_code, resume.len);
+      bufpool_release(resume.buf);
+      resume.buf = NULL;
     }
-    if (state.image_url != NULL) {
-      free(state.image_url);
-      state.image_url = NULL;
+
+    if (status_code == 200) {
+      if (!resumed) {
+        s_download_stats.started++;
+        state.total = content_length > 0 ? (size_t)content_length : 0;
+      }
+      err = remote_read_body(http, &state, content_length);
+    } else {
+      // Nothing to keep, but drain it so the connection stays usable
+      esp_http_client_flush_response(http, NULL);
     }
-    esp_http_client_cleanup(http);
-    return 1;
+  }
+  if (resume.buf != NULL) {
+    // Failed before any of the body arrived: the partial is as good as it
+    // was, but counts as an attempt that made no progress
+    state.buf = resume.buf;
+    state.len = resume.len;
+    state.size = resume.size;
+    state.total = resume.total;
+  }
+  int32_t resume_in_secs = -1;
+  if (err != ESP_OK && !state.oversize_detected && state.buf != NULL) {
+    resume_in_secs = partial_keep(url, &state, resume.len, resume.stalls);
+    if (resume_in_secs >= 0) state.buf = NULL;  // Kept for the next attempt
+  }
+  record_timing(&state);
+  s_http_warm = err == ESP_OK && !state.oversize_detected;
+  if (err == ESP_OK) {
+    // A response without the header turns long-polling back off
+    s_poll_hint.max_age_secs = state.max_age_secs;
+    s_poll_hint.retry_after_secs = state.retry_after_secs;
+    s_poll_hint.long_poll_secs = state.long_poll_secs;
+  } else {
+    s_poll_hint.max_age_secs = -1;
+    s_poll_hint.retry_after_secs = resume_in_secs;
   }
 
-  // Check if oversize was detected during the request
+  // Check if oversize was detected from the headers or while reading
   if (state.oversize_detected) {
     ESP_LOGI(TAG, "Request aborted due to oversize content");
-    if (state.buf != NULL) {
-      free(state.buf);
+    // Display the oversize graphic
+    if (gfx_display_asset("oversize") != 0) {
+      ESP_LOGE(TAG, "Failed to display oversize graphic");
     }
+    bufpool_release(state.buf);
     if (state.ota_url != NULL) {
       free(state.ota_url);
     }
     if (state.image_url != NULL) {
       free(state.image_url);
     }
-    esp_http_client_cleanup(http);
+    remote_client_reset();  // The response was abandoned mid-body
     *return_status_code = 413;  // HTTP 413 Payload Too Large
     return 1;  // Return error so main loop doesn't process the result
   }
 
-  int status_code = esp_http_client_get_status_code(http);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "couldn't reach %s: %s", url, esp_err_to_name(err));
+    bufpool_release(state.buf);
+    if (state.image_url != NULL) {
+      free(state.image_url);
+      state.image_url = NULL;
+    }
+    remote_client_reset();
+    return 1;
+  }
+
   *return_status_code = status_code;
-  if (status_code != 200) {
+  if (status_code == 304) {
+    // Unchanged: no body, the caller keeps showing what it has
+    ESP_LOGI(TAG, "Not modified");
+  } else if (status_code != 200) {
+    // Don't let stale validators turn the next success into a 304 for an
+    // image the caller may no longer have
+    validator_forget(url);
     ESP_LOGE(TAG, "Server returned HTTP status %d", status_code);
-    if (state.buf != NULL) {
-      free(state.buf);
-    }
     if (state.ota_url != NULL) {
       free(state.ota_url);
     }
     if (state.image_url != NULL) {
       free(state.image_url);
     }
-    esp_http_client_cleanup(http);
     return 1;
   }
 
+  if (status_code == 200) {
+    if (bundle_is_bundle(state.buf, state.len)) {
+      // A bundle is unpacked and gone, so a 304 could not replay its
+      // rotation; always fetch it in full
+      validator_forget(url);
+    } else {
+      validator_store(url, &state);
+    }
+    s_download_stats.completed++;
+    log_download_stats();
+  }
+
   // Write back the results.
   *buf = state.buf;
   *len = state.len;
@@ -305,7 +785,6 @@ int remote_get(const char* url, uint8_t** buf, size_t* len,
   *image_url = state.image_url;
   *reboot_requested = state.reboot_requested;
 
-  esp_http_client_cleanup(http);
   // ESP_LOGI(TAG,"fetched new webp");
   return 0;
 }
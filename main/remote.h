@@ -1,10 +1,60 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-// Retrieves url via HTTP GET. Caller is responsible for freeing buf,
-// ota_url, and image_url (if not NULL) on success.
+// Breakdown of the last remote_get() request.
+typedef struct {
+  int64_t connect_us;   // TCP connect and TLS handshake, 0 when reused
+  int64_t ttfb_us;      // Request sent until the first response header
+  int64_t transfer_us;  // First header until the body was complete
+  size_t bytes;
+  bool reused;  // Kept-alive connection, no new handshake
+} remote_timing_t;
+
+// Server hints from the last remote_get() response for when to poll next.
+typedef struct {
+  int32_t max_age_secs;      // Cache-Control max-age, -1 if none
+  int32_t retry_after_secs;  // Retry-After in seconds, -1 if none
+  // Tronbyt-Long-Poll: the server holds requests carrying the content hash
+  // for up to this long and answers early on a change; 0 = plain polling
+  uint32_t long_poll_secs;
+} remote_poll_hint_t;
+
+// Downloads over the device's lifetime, for the completion rate.
+typedef struct {
+  uint32_t started;        // 200 responses whose body was read
+  uint32_t completed;      // Bodies received in full, directly or resumed
+  uint32_t resumes;        // Range requests answered with the missing part
+  uint64_t resumed_bytes;  // Bytes that did not have to be fetched again
+} remote_download_stats_t;
+
+// Retrieves url via HTTP GET. Caller is responsible for releasing buf with
+// bufpool_release() and freeing ota_url and image_url (if not NULL) on
+// success. Requests are conditional
+// once the server has sent an ETag or Last-Modified for url (bundles are
+// always fetched in full); a 304 succeeds
+// with *buf set to NULL, *len to 0 and return_code to 304. Once the server
+// offers long-polling, requests also carry the hash of the last body and a
+// wait, and may block until the content changes. A body that breaks off
+// mid-transfer is kept when the server sent a validator, and the next call
+// for the same url asks only for the rest (Range with If-Range); the poll
+// hint then carries the backoff before that attempt.
 int remote_get(const char* url, uint8_t** buf, size_t* len,
                uint8_t* brightness_pct, int32_t* dwell_secs, int* return_code,
-               char** ota_url, char** image_url, bool* reboot_requested);
\ No newline at end of file
+               char** ota_url, char** image_url, bool* reboot_requested);
+
+// Drops what is known about url's last body, so the next remote_get() for it
+// fetches it in full instead of getting a 304, e.g. after it failed to
+// decode.
+void remote_forget_validator(const char* url);
+
+// Timing of the most recent remote_get() call.
+void remote_get_last_timing(remote_timing_t* timing);
+
+// Scheduling hints of the most recent remote_get() call.
+void remote_get_poll_hint(remote_poll_hint_t* hint);
+
+// Download counters since boot.
+void remote_get_download_stats(remote_download_stats_t* stats);
@@ -0,0 +1,290 @@
+#include "sse.h"
+
+#include <esp_crt_bundle.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_events.h"
+#include "nvs_settings.h"
+#include "version.h"
+
+static const char *TAG = "sse";
+
+// Runs the TLS session and the control handler, which parses the JSON and
+// may write NVS (e.g. before a reboot); sized like the WebSocket client's
+// task, which runs the same handler. The high-water mark is logged after
+// every stream.
+#define SSE_TASK_STACK 8192
+#define SSE_RX_BUFFER 1024
+#define SSE_LINE_MAX 1024  // Longer lines are dropped
+#define SSE_DATA_MAX 2048  // Larger events are dropped
+#define SSE_EVENT_MAX 16
+#define SSE_ID_MAX 64
+// Servers send a comment line at least this often to keep the stream alive;
+// a quiet stream is treated as dead
+#define SSE_IDLE_TIMEOUT_MS 60000
+#define SSE_RETRY_DEFAULT_MS 3000
+#define SSE_RETRY_MAX_MS 60000
+
+struct sse_state {
+  char url[MAX_URL_LEN + 2];  // http(s):// form of the stream URL
+  sse_control_cb_t on_control;
+  // Line being received and the data lines of the event being built
+  char line[SSE_LINE_MAX];
+  size_t line_len;
+  bool line_overflow;
+  char data[SSE_DATA_MAX];
+  size_t data_len;
+  bool data_overflow;
+  char event[SSE_EVENT_MAX];
+  char last_id[SSE_ID_MAX];
+  uint32_t retry_ms;
+};
+
+static struct sse_state *_state;
+static volatile bool _connected;
+static char *_pending_image_url;
+static portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+bool sse_is_url(const char *url) {
+  return strncmp(url, "sse://", 6) == 0 || strncmp(url, "sses://", 7) == 0;
+}
+
+static void set_connected(bool connected) {
+  if (_connected == connected) return;
+  _connected = connected;
+  ESP_LOGI(TAG, "Event stream %s", connected ? "open" : "closed");
+  app_events_post(APP_EVENT_PUSH_STATE);
+}
+
+// Resolves an image URL from an event against the stream's scheme and host.
+static char *resolve_image_url(const char *url) {
+  if (strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0) {
+    return strdup(url);
+  }
+  if (url[0] != '/') {
+    ESP_LOGW(TAG, "Ignoring image URL %s", url);
+    return NULL;
+  }
+
+  const char *host = strstr(_state->url, "://") + 3;
+  const char *path = strchr(host, '/');
+  size_t origin_len = path != NULL ? path - _state->url : strlen(_state->url);
+  char *resolved = malloc(origin_len + strlen(url) + 1);
+  if (resolved != NULL) {
+    memcpy(resolved, _state->url, origin_len);
+    strcpy(resolved + origin_len, url);
+  }
+  return resolved;
+}
+
+static void dispatch_event(struct sse_state *st) {
+  if (st->data_overflow) {
+    ESP_LOGW(TAG, "Dropping event larger than %d bytes", SSE_DATA_MAX);
+  } else if (st->data_len == 0) {
+    // Nothing to dispatch (e.g. just an id or retry)
+  } else if (strcmp(st->event, "image") == 0) {
+    char *url = resolve_image_url(st->data);
+    if (url != NULL) {
+      ESP_LOGD(TAG, "Image announced: %s", url);
+      portENTER_CRITICAL(&_lock);
+      char *superseded = _pending_image_url;
+      _pending_image_url = url;
+      portEXIT_CRITICAL(&_lock);
+      free(superseded);
+      app_events_post(APP_EVENT_PUSH_IMAGE);
+    }
+  } else if (st->event[0] == '\0' || strcmp(st->event, "control") == 0) {
+    st->on_control(st->data);
+  } else {
+    ESP_LOGD(TAG, "Ignoring event type %s", st->event);
+  }
+
+  st->event[0] = '\0';
+  st->data[0] = '\0';
+  st->data_len = 0;
+  st->data_overflow = false;
+}
+
+static void process_line(struct sse_state *st) {
+  if (st->line_len == 0) {
+    dispatch_event(st);
+    return;
+  }
+  if (st->line[0] == ':') return;  // Comment, used as keep-alive
+
+  char *value = strchr(st->line, ':');
+  if (value != NULL) {
+    *value++ = '\0';
+    if (*value == ' ') value++;
+  } else {
+    value = st->line + st->line_len;  // Field name only, empty value
+  }
+
+  if (strcmp(st->line, "data") == 0) {
+    size_t value_len = strlen(value);
+    size_t sep = st->data_len > 0 ? 1 : 0;
+    if (st->data_len + sep + value_len >= sizeof(st->data)) {
+      st->data_overflow = true;
+      return;
+    }
+    if (sep) st->data[st->data_len++] = '\n';
+    memcpy(st->data + st->data_len, value, value_len + 1);
+    st->data_len += value_len;
+  } else if (strcmp(st->line, "event") == 0) {
+    strlcpy(st->event, value, sizeof(st->event));
+  } else if (strcmp(st->line, "id") == 0) {
+    strlcpy(st->last_id, value, sizeof(st->last_id));
+  } else if (strcmp(st->line, "retry") == 0) {
+    if (value[0] >= '0' && value[0] <= '9') {
+      st->retry_ms = strtoul(value, NULL, 10);
+      if (st->retry_ms > SSE_RETRY_MAX_MS) st->retry_ms = SSE_RETRY_MAX_MS;
+    }
+  }
+}
+
+static void feed(struct sse_state *st, const char *buf, int len) {
+  for (int i = 0; i < len; i++) {
+    char c = buf[i];
+    if (c == '\r') continue;  // CRLF line endings
+    if (c != '\n') {
+      if (st->line_len < sizeof(st->line) - 1) {
+        st->line[st->line_len++] = c;
+      } else {
+        st->line_overflow = true;
+      }
+      continue;
+    }
+
+    st->line[st->line_len] = '\0';
+    if (!st->line_overflow) {
+      process_line(st);
+    } else if (strncmp(st->line, "data", 4) == 0) {
+      st->data_overflow = true;  // The event would be incomplete
+    }
+    st->line_len = 0;
+    st->line_overflow = false;
+  }
+}
+
+static esp_err_t http_event_handler(esp_http_client_event_t *event) {
+  struct sse_state *st = (struct sse_state *)event->user_data;
+  if (event->event_id == HTTP_EVENT_ON_DATA &&
+      esp_http_client_get_status_code(event->client) == 200) {
+    set_connected(true);
+    feed(st, (const char *)event->data, event->data_len);
+  }
+  return ESP_OK;
+}
+
+// Holds one stream open until the server ends it or it goes quiet. Returns
+// true if events were received, so the retry backoff can start over.
+static bool run_stream(struct sse_state *st) {
+  esp_http_client_config_t config = {
+      .url = st->url,
+      .event_handler = http_event_handler,
+      .user_data = st,
+      .timeout_ms = SSE_IDLE_TIMEOUT_MS,
+      .buffer_size = SSE_RX_BUFFER,
+      .crt_bundle_attach = esp_crt_bundle_attach,
+  };
+  esp_http_client_handle_t http = esp_http_client_init(&config);
+  if (http == NULL) {
+    ESP_LOGE(TAG, "HTTP client initialization failed for URL: %s", st->url);
+    return false;
+  }
+
+  esp_http_client_set_header(http, "Accept", "text/event-stream");
+  esp_http_client_set_header(http, "Cache-Control", "no-cache");
+  esp_http_client_set_header(http, "X-Firmware-Version", FIRMWARE_VERSION);
+  char api_key[MAX_API_KEY_LEN + 1];
+  if (nvs_get_api_key(api_key, sizeof(api_key)) == ESP_OK &&
+      strlen(api_key) > 0) {
+    char auth_header[64 + MAX_API_KEY_LEN];
+    snprintf(auth_header, sizeof(auth_header), "Bearer %s", api_key);
+    esp_http_client_set_header(http, "Authorization", auth_header);
+  }
+  if (st->last_id[0] != '\0') {
+    esp_http_client_set_header(http, "Last-Event-ID", st->last_id);
+  }
+
+  st->line_len = 0;
+  st->line_overflow = false;
+  st->event[0] = '\0';
+  st->data_len = 0;
+  st->data_overflow = false;
+
+  // Returns once the stream ends: the server closed it, or nothing (not
+  // even a keep-alive comment) arrived within the idle timeout
+  esp_err_t err = esp_http_client_perform(http);
+  bool received = _connected;
+  int status_code = esp_http_client_get_status_code(http);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Event stream ended: %s", esp_err_to_name(err));
+  } else if (status_code == 204) {
+    // The server asks the client to stop reconnecting; back off fully
+    ESP_LOGW(TAG, "Server closed the event stream (204)");
+    st->retry_ms = SSE_RETRY_MAX_MS;
+  } else if (status_code != 200) {
+    ESP_LOGE(TAG, "Server returned HTTP status %d", status_code);
+  }
+  esp_http_client_cleanup(http);
+  set_connected(false);
+  return received;
+}
+
+static void sse_task(void *arg) {
+  struct sse_state *st = (struct sse_state *)arg;
+  uint32_t backoff_ms = st->retry_ms;
+  for (;;) {
+    if (run_stream(st)) backoff_ms = st->retry_ms;
+    ESP_LOGI(TAG, "Stack remaining: %u bytes",
+             uxTaskGetStackHighWaterMark(NULL));
+    ESP_LOGI(TAG, "Reconnecting in %" PRIu32 " ms", backoff_ms);
+    vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+    // Back off while the server stays unreachable
+    backoff_ms *= 2;
+    if (backoff_ms > SSE_RETRY_MAX_MS) backoff_ms = SSE_RETRY_MAX_MS;
+  }
+}
+
+int sse_start(const char *url, sse_control_cb_t on_control) {
+  if (_state != NULL || !sse_is_url(url)) return 1;
+
+  _state = calloc(1, sizeof(*_state));
+  if (_state == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate SSE state");
+    return 1;
+  }
+  // sse://host/path -> http://host/path, sses:// -> https://
+  const char *rest = strstr(url, "://");
+  snprintf(_state->url, sizeof(_state->url), "%s%s",
+           url[3] == 's' ? "https" : "http", rest);
+  _state->on_control = on_control;
+  _state->retry_ms = SSE_RETRY_DEFAULT_MS;
+
+  if (xTaskCreate(sse_task, "sse", SSE_TASK_STACK, _state, 5, NULL) !=
+      pdPASS) {
+    ESP_LOGE(TAG, "Failed to create SSE task");
+    free(_state);
+    _state = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+bool sse_is_connected(void) { return _connected; }
+
+char *sse_take_image_url(void) {
+  portENTER_CRITICAL(&_lock);
+  char *url = _pending_image_url;
+  _pending_image_url = NULL;
+  portEXIT_CRITICAL(&_lock);
+  return url;
+}
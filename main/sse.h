@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Called with the data of each control event (a JSON object)
+ *
+ * Runs on the SSE task.
+ */
+typedef void (*sse_control_cb_t)(const char *json);
+
+/**
+ * @brief Check whether url selects the Server-Sent Events transport
+ *
+ * @return true for sse:// (plain HTTP) and sses:// (HTTPS) URLs
+ */
+bool sse_is_url(const char *url);
+
+/**
+ * @brief Start listening to the event stream at url
+ *
+ * A single long-lived GET to the http(s) form of url receives the events:
+ * "image" events carry the URL of the next image (absolute, or relative to
+ * the stream's host) and "control" or unnamed events carry the same JSON
+ * control messages as the WebSocket. The task reconnects on its own, honoring
+ * the server's retry interval and resuming with Last-Event-ID. Connection
+ * changes post APP_EVENT_PUSH_STATE and image events APP_EVENT_PUSH_IMAGE.
+ *
+ * @param url sse:// or sses:// URL
+ * @param on_control Control event handler
+ * @return int 0 on success
+ */
+int sse_start(const char *url, sse_control_cb_t on_control);
+
+/**
+ * @brief Check whether the event stream is currently open
+ */
+bool sse_is_connected(void);
+
+/**
+ * @brief Take the most recently announced image URL
+ *
+ * Images that were announced but not taken yet are superseded by newer ones.
+ *
+ * @return Absolute http(s) URL the caller must free, or NULL if none is
+ *         pending
+ */
+char *sse_take_image_url(void);
+
+#ifdef __cplusplus
+}
+#endif
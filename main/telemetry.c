@@ -0,0 +1,359 @@
+#include "telemetry.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gfx.h"
+#include "wifi.h"
+#include "wsout.h"
+
+static const char *TAG = "telemetry";
+
+#define TELEMETRY_TASK_STACK 4096
+// Every this many reports everything is sent, not just what changed
+#define TELEMETRY_FULL_EVERY 6
+#define TELEMETRY_FETCH_SAMPLES 32
+#define TELEMETRY_MAX_TASKS 24
+
+// Values that are only sent when they change
+enum {
+  FIELD_HEAP_FREE,
+  FIELD_HEAP_BLOCK,
+  FIELD_PSRAM_FREE,
+  FIELD_PSRAM_BLOCK,
+  FIELD_RSSI,
+  FIELD_FPS10,  // Tenths of a frame per second, sent as a float
+  FIELD_WIFI_DISCONNECTS,
+  FIELD_RECONNECTS,
+  FIELD_OUT_DROPPED,
+  FIELD_FETCH_P50,
+  FIELD_FETCH_P90,
+  FIELD_FETCH_P99,
+  FIELD_COUNT,
+};
+
+static const char *const _field_keys[FIELD_COUNT] = {
+    "hi", "hib", "hp", "hpb", "rssi", "fps", "wdc", "rc", "od",
+    "f50", "f90", "f99",
+};
+
+struct cbor_out {
+  uint8_t *buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+};
+
+static TaskHandle_t _task;
+static telemetry_send_cb_t _send;
+static volatile uint32_t _interval_secs;
+static volatile bool _full_requested = true;
+static volatile uint32_t _connects;
+static uint32_t _seq;
+
+// Last values delivered, for deltas
+static int32_t _sent[FIELD_COUNT];
+static bool _sent_valid[FIELD_COUNT];
+
+static uint32_t _fetch_ms[TELEMETRY_FETCH_SAMPLES];
+static int _fetch_count;
+static int _fetch_next;
+static portMUX_TYPE _fetch_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Previous sample of the render and run time counters
+static int64_t _prev_us;
+static uint32_t _prev_frames;
+static uint32_t _prev_late;
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+struct task_sample {
+  UBaseType_t number;
+  configRUN_TIME_COUNTER_TYPE runtime;
+  uint8_t pct;  // Last sent
+};
+
+static TaskStatus_t _tasks[TELEMETRY_MAX_TASKS];
+static struct task_sample _task_prev[TELEMETRY_MAX_TASKS];
+static int _task_prev_count;
+static configRUN_TIME_COUNTER_TYPE _prev_total_runtime;
+#endif
+
+static void put_head(struct cbor_out *o, uint8_t major, uint64_t arg) {
+  uint8_t head[9];
+  size_t n;
+  if (arg < 24) {
+    head[0] = major << 5 | arg;
+    n = 1;
+  } else if (arg <= UINT8_MAX) {
+    head[0] = major << 5 | 24;
+    head[1] = arg;
+    n = 2;
+  } else if (arg <= UINT16_MAX) {
+    head[0] = major << 5 | 25;
+    head[1] = arg >> 8;
+    head[2] = arg;
+    n = 3;
+  } else {
+    head[0] = major << 5 | 26;
+    for (int i = 0; i < 4; i++) head[1 + i] = arg >> (24 - 8 * i);
+    n = 5;
+  }
+  if (o->len + n > o->cap) {
+    o->overflow = true;
+    return;
+  }
+  memcpy(o->buf + o->len, head, n);
+  o->len += n;
+}
+
+static void put_byte(struct cbor_out *o, uint8_t b) {
+  if (o->len + 1 > o->cap) {
+    o->overflow = true;
+    return;
+  }
+  o->buf[o->len++] = b;
+}
+
+static void put_text(struct cbor_out *o, const char *s) {
+  size_t n = strlen(s);
+  put_head(o, 3, n);
+  if (o->len + n > o->cap) {
+    o->overflow = true;
+    return;
+  }
+  memcpy(o->buf + o->len, s, n);
+  o->len += n;
+}
+
+static void put_int(struct cbor_out *o, const char *key, int32_t v) {
+  put_text(o, key);
+  if (v >= 0) {
+    put_head(o, 0, (uint64_t)v);
+  } else {
+    put_head(o, 1, (uint64_t)(-1 - (int64_t)v));
+  }
+}
+
+static void put_float(struct cbor_out *o, const char *key, float v) {
+  put_text(o, key);
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  put_byte(o, 0xFA);
+  for (int i = 0; i < 4; i++) put_byte(o, bits >> (24 - 8 * i));
+}
+
+static int compare_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Fills the fetch percentiles from the recent samples. Returns false if
+// there are none.
+static bool fetch_percentiles(int32_t *p50, int32_t *p90, int32_t *p99) {
+  uint32_t sorted[TELEMETRY_FETCH_SAMPLES];
+  portENTER_CRITICAL(&_fetch_lock);
+  int n = _fetch_count;
+  memcpy(sorted, _fetch_ms, n * sizeof(sorted[0]));
+  portEXIT_CRITICAL(&_fetch_lock);
+  if (n == 0) return false;
+
+  qsort(sorted, n, sizeof(sorted[0]), compare_u32);
+  *p50 = sorted[(n - 1) * 50 / 100];
+  *p90 = sorted[(n - 1) * 90 / 100];
+  *p99 = sorted[(n - 1) * 99 / 100];
+  return true;
+}
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+// Adds the CPU share of each task since the previous report. Between
+// snapshots only tasks whose share changed are listed.
+static void put_cpu(struct cbor_out *o, bool full) {
+  configRUN_TIME_COUNTER_TYPE total;
+  UBaseType_t count = uxTaskGetSystemState(_tasks, TELEMETRY_MAX_TASKS, &total);
+  if (count == 0) return;  // More tasks than slots
+
+  configRUN_TIME_COUNTER_TYPE elapsed =
+      (total - _prev_total_runtime) * portNUM_PROCESSORS;
+  bool first = _prev_total_runtime == 0;
+  _prev_total_runtime = total;
+
+  bool open = false;
+  struct task_sample samples[TELEMETRY_MAX_TASKS];
+  for (UBaseType_t i = 0; i < count; i++) {
+    TaskStatus_t *t = &_tasks[i];
+    configRUN_TIME_COUNTER_TYPE prev_runtime = 0;
+    int last_pct = -1;
+    for (int j = 0; j < _task_prev_count; j++) {
+      if (_task_prev[j].number == t->xTaskNumber) {
+        prev_runtime = _task_prev[j].runtime;
+        last_pct = _task_prev[j].pct;
+        break;
+      }
+    }
+
+    int pct = 0;
+    if (!first && elapsed > 0) {
+      pct = (int)((uint64_t)(t->ulRunTimeCounter - prev_runtime) * 100 /
+                  elapsed);
+    }
+    samples[i].number = t->xTaskNumber;
+    samples[i].runtime = t->ulRunTimeCounter;
+    samples[i].pct = pct;
+
+    if (first || (full ? pct == 0 : pct == last_pct)) continue;
+    if (!open) {
+      put_text(o, "cpu");
+      put_byte(o, 0xBF);  // Indefinite-length map
+      open = true;
+    }
+    put_int(o, t->pcTaskName, pct);
+  }
+  if (open) put_byte(o, 0xFF);
+
+  memcpy(_task_prev, samples, count * sizeof(samples[0]));
+  _task_prev_count = count;
+}
+#endif
+
+static void report(void) {
+  static uint8_t buf[TELEMETRY_REPORT_MAX];
+  struct cbor_out o = {.buf = buf, .cap = sizeof(buf)};
+
+  bool full = _full_requested || _seq % TELEMETRY_FULL_EVERY == 0;
+  _full_requested = false;
+
+  int64_t now_us = esp_timer_get_time();
+  uint32_t frames, late;
+  gfx_get_render_stats(&frames, &late);
+  int64_t elapsed_us = now_us - _prev_us;
+
+  int32_t values[FIELD_COUNT];
+  bool present[FIELD_COUNT];
+  for (int i = 0; i < FIELD_COUNT; i++) present[i] = true;
+  values[FIELD_HEAP_FREE] =
+      heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) / 1024;
+  values[FIELD_HEAP_BLOCK] =
+      heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) /
+      1024;
+  values[FIELD_PSRAM_FREE] = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / 1024;
+  values[FIELD_PSRAM_BLOCK] =
+      heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) / 1024;
+  int8_t rssi;
+  present[FIELD_RSSI] = wifi_get_rssi(&rssi) == 0;
+  values[FIELD_RSSI] = present[FIELD_RSSI] ? rssi : 0;
+  values[FIELD_FPS10] =
+      elapsed_us > 0
+          ? (int32_t)((frames - _prev_frames) * 10000000LL / elapsed_us)
+          : 0;
+  values[FIELD_WIFI_DISCONNECTS] = wifi_get_disconnect_count();
+  values[FIELD_RECONNECTS] = _connects > 0 ? _connects - 1 : 0;
+  wsout_stats_t out_stats;
+  wsout_get_stats(&out_stats);
+  values[FIELD_OUT_DROPPED] = out_stats.dropped;
+  bool have_fetch =
+      fetch_percentiles(&values[FIELD_FETCH_P50], &values[FIELD_FETCH_P90],
+                        &values[FIELD_FETCH_P99]);
+  present[FIELD_FETCH_P50] = present[FIELD_FETCH_P90] =
+      present[FIELD_FETCH_P99] = have_fetch;
+
+  put_byte(&o, 0xBF);  // Indefinite-length map
+  put_int(&o, "seq", _seq);
+  if (full) {
+    put_text(&o, "full");
+    put_byte(&o, 0xF5);
+  }
+  put_int(&o, "up", now_us / 1000000);
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    if (!present[i]) continue;
+    if (!full && _sent_valid[i] && _sent[i] == values[i]) {
+      present[i] = false;  // Unchanged
+      continue;
+    }
+    if (i == FIELD_FPS10) {
+      put_float(&o, _field_keys[i], values[i] / 10.0f);
+    } else {
+      put_int(&o, _field_keys[i], values[i]);
+    }
+  }
+  put_int(&o, "late", late - _prev_late);
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+  put_cpu(&o, full);
+#endif
+  put_byte(&o, 0xFF);
+
+  _prev_us = now_us;
+  _prev_frames = frames;
+  _prev_late = late;
+  _seq++;
+
+  if (o.overflow) {
+    ESP_LOGW(TAG, "Report does not fit in %d bytes", TELEMETRY_REPORT_MAX);
+    _full_requested = true;
+    return;
+  }
+  if (_send(buf, o.len) != 0) {
+    // The server may have missed what changed; resend everything next time
+    _full_requested = true;
+    return;
+  }
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    if (!present[i]) continue;
+    _sent[i] = values[i];
+    _sent_valid[i] = true;
+  }
+  ESP_LOGD(TAG, "Sent report %" PRIu32 " (%zu bytes%s)", _seq - 1, o.len,
+           full ? ", full" : "");
+}
+
+static void telemetry_task(void *arg) {
+  _prev_us = esp_timer_get_time();
+  for (;;) {
+    uint32_t interval_secs = _interval_secs;
+    TickType_t wait = interval_secs > 0
+                          ? pdMS_TO_TICKS(interval_secs * 1000)
+                          : portMAX_DELAY;
+    // A notification means the interval changed: start the wait over
+    if (ulTaskNotifyTake(pdTRUE, wait) > 0) continue;
+    if (_interval_secs > 0) report();
+  }
+}
+
+int telemetry_start(uint32_t interval_secs, telemetry_send_cb_t send) {
+  if (_task != NULL) return 1;
+  _send = send;
+  _interval_secs = interval_secs;
+  // Lowest priority above idle, so collection never competes with rendering
+  if (xTaskCreate(telemetry_task, "telemetry", TELEMETRY_TASK_STACK, NULL, 1,
+                  &_task) != pdPASS) {
+    ESP_LOGE(TAG, "Could not create telemetry task");
+    return 1;
+  }
+  ESP_LOGI(TAG, "Reporting every %" PRIu32 " s", interval_secs);
+  return 0;
+}
+
+void telemetry_set_interval(uint32_t interval_secs) {
+  _interval_secs = interval_secs;
+  if (_task != NULL) xTaskNotifyGive(_task);
+}
+
+void telemetry_note_connect(void) {
+  _connects++;
+  _full_requested = true;
+}
+
+void telemetry_record_fetch_ms(uint32_t ms) {
+  portENTER_CRITICAL(&_fetch_lock);
+  _fetch_ms[_fetch_next] = ms;
+  _fetch_next = (_fetch_next + 1) % TELEMETRY_FETCH_SAMPLES;
+  if (_fetch_count < TELEMETRY_FETCH_SAMPLES) _fetch_count++;
+  portEXIT_CRITICAL(&_fetch_lock);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest encoded report
+#define TELEMETRY_REPORT_MAX 512
+
+/**
+ * @brief Delivers one encoded report; returns 0 if it was sent
+ *
+ * Runs on the telemetry task, which may block here.
+ */
+typedef int (*telemetry_send_cb_t)(const uint8_t *report, size_t len);
+
+/**
+ * @brief Start sending periodic device telemetry
+ *
+ * Every interval a CBOR map is built and handed to send. Its keys:
+ *
+ *   seq   report number               full  true for a complete snapshot
+ *   up    uptime (s)                  rssi  WiFi signal (dBm)
+ *   hi    free internal heap (KiB)    hib   largest internal block (KiB)
+ *   hp    free PSRAM (KiB)            hpb   largest PSRAM block (KiB)
+ *   fps   frames drawn per second     late  frames that missed their time
+ *   wdc   WiFi disconnects            rc    push transport reconnects
+ *   od    outbound messages dropped   cpu   map of task name to CPU %
+ *   f50, f90, f99  image fetch time percentiles (ms)
+ *
+ * cpu is only sent when FreeRTOS run time stats are enabled
+ * (CONFIG_TELEMETRY_TASK_CPU).
+ *
+ * Between snapshots a report only carries the values that changed since the
+ * previous one, plus seq, up and late.
+ *
+ * @param interval_secs Seconds between reports; 0 pauses them
+ * @return int 0 on success
+ */
+int telemetry_start(uint32_t interval_secs, telemetry_send_cb_t send);
+
+/**
+ * @brief Change the report interval; 0 pauses the reports
+ */
+void telemetry_set_interval(uint32_t interval_secs);
+
+/**
+ * @brief Count a (re)connection of the push transport
+ *
+ * The next report after it is a full snapshot, since the server may have
+ * missed the ones before.
+ */
+void telemetry_note_connect(void);
+
+/**
+ * @brief Add an image fetch or receive time to the percentiles
+ */
+void telemetry_record_fetch_ms(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "ap.h"
+#include "app_events.h"
 #include "esp_event.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
@@ -45,6 +46,8 @@ static void (*s_config_callback)(void) = NULL;
 
 // Reconnection counter
 static int s_reconnect_attempts = 0;
+// Disconnects since boot, unlike s_reconnect_attempts never reset
+static uint32_t s_disconnect_count = 0;
 static bool s_connection_given_up = false;
 
 // Counter for tracking consecutive WiFi disconnections
@@ -213,6 +216,17 @@ bool wifi_is_connected(void) {
   return (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) != 0;
 }
 
+// Get the signal strength of the current AP
+int wifi_get_rssi(int8_t* rssi) {
+  wifi_ap_record_t ap_info;
+  if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) return 1;
+  *rssi = ap_info.rssi;
+  return 0;
+}
+
+// Count station disconnects since boot
+uint32_t wifi_get_disconnect_count(void) { return s_disconnect_count; }
+
 // Wait for WiFi connection with timeout
 bool wifi_wait_for_connection(uint32_t timeout_ms) {
   ESP_LOGI(TAG, "Waiting for WiFi connection (timeout: %lu ms)",
@@ -231,16 +245,13 @@ bool wifi_wait_for_connection(uint32_t timeout_ms) {
     return false;
   }
 
-  // Wait for connection or timeout
-  TickType_t start_ticks = xTaskGetTickCount();
-  TickType_t timeout_ticks = pdMS_TO_TICKS(timeout_ms);
-
-  while (xTaskGetTickCount() - start_ticks < timeout_ticks) {
-    if (wifi_is_connected()) {
-      ESP_LOGI(TAG, "Connected to WiFi");
-      return true;
-    }
-    vTaskDelay(pdMS_TO_TICKS(100));  // Check every 100ms
+  // Block until the IP event handler sets the bit, or timeout
+  EventBits_t bits =
+      xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE,
+                          pdTRUE, pdMS_TO_TICKS(timeout_ms));
+  if (bits & WIFI_CONNECTED_BIT) {
+    ESP_LOGI(TAG, "Connected to WiFi");
+    return true;
   }
 
   ESP_LOGW(TAG, "WiFi connection timeout");
@@ -283,6 +294,7 @@ static void handle_successful_ip_acquisition(void) {
   // Set connection bit and clear fail bit
   xEventGroupClearBits(s_wifi_event_group, WIFI_FAIL_BIT);
   xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+  app_events_post(APP_EVENT_WIFI_UP);
 }
 
 // WiFi event handler
@@ -309,6 +321,7 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
       case WIFI_EVENT_STA_DISCONNECTED:
         // Increment reconnection counter
         s_reconnect_attempts++;
+        s_disconnect_count++;
 
         // Clear connection bit and set fail bit
         xEventGroupClearBits(s_wifi_event_group,
@@ -78,6 +78,19 @@ void wifi_health_check(void);
  */
 void wifi_apply_power_save(void);
 
+/**
+ * @brief Get the signal strength of the current access point
+ *
+ * @param rssi Set to the RSSI in dBm
+ * @return 0 on success, non-zero when not connected
+ */
+int wifi_get_rssi(int8_t *rssi);
+
+/**
+ * @brief Number of station disconnects since boot
+ */
+uint32_t wifi_get_disconnect_count(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,301 @@
+#include "wsframe.h"
+
+#include <esp_rom_crc.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+// CBOR major types
+#define CBOR_UINT 0
+#define CBOR_NEGINT 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+#define CBOR_SIMPLE 7
+
+#define CBOR_INDEFINITE 31
+#define CBOR_BREAK 0xFF
+// Deepest nesting skipped inside a control value
+#define CBOR_NESTING_MAX 16
+
+static uint16_t read_le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t read_le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int wsframe_parse_header(const uint8_t *buf, size_t len,
+                         wsframe_header_t *header) {
+  if (len < WSFRAME_HEADER_LEN || buf[0] != WSFRAME_VERSION) return 1;
+
+  header->type = buf[1];
+  header->flags = buf[2];
+  header->zone = buf[3];
+  header->dwell_secs = read_le16(buf + 4);
+  header->ttl_secs = read_le16(buf + 6);
+  header->seq = read_le32(buf + 8);
+  header->crc = read_le32(buf + 12);
+  memcpy(header->app_id, buf + 16, WSFRAME_APP_ID_LEN);
+  header->app_id[WSFRAME_APP_ID_LEN] = '\0';
+  header->timestamp_ms = 0;
+  header->header_len = WSFRAME_HEADER_LEN;
+
+  if (header->flags & WSFRAME_FLAG_TIMESTAMP) {
+    if (len < WSFRAME_HEADER_LEN + WSFRAME_TIMESTAMP_LEN) return 1;
+    header->timestamp_ms =
+        read_le32(buf + WSFRAME_HEADER_LEN) |
+        (uint64_t)read_le32(buf + WSFRAME_HEADER_LEN + 4) << 32;
+    header->header_len += WSFRAME_TIMESTAMP_LEN;
+  }
+  return header->type == WSFRAME_TYPE_IMAGE ||
+                 header->type == WSFRAME_TYPE_CONTROL
+             ? 0
+             : 1;
+}
+
+static void write_le32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = v >> (8 * i);
+}
+
+void wsframe_write_header(uint8_t *out, uint8_t type, uint32_t seq,
+                          const uint8_t *payload, size_t len) {
+  memset(out, 0, WSFRAME_HEADER_LEN);
+  out[0] = WSFRAME_VERSION;
+  out[1] = type;
+  write_le32(out + 8, seq);
+  write_le32(out + 12, esp_rom_crc32_le(0, payload, len));
+}
+
+struct cursor {
+  const uint8_t *p;
+  const uint8_t *end;
+};
+
+// Reads an initial byte and its argument. For CBOR_INDEFINITE, *arg is 0.
+static int read_head(struct cursor *c, uint8_t *major, uint8_t *info,
+                     uint64_t *arg) {
+  if (c->p >= c->end) return 1;
+  uint8_t initial = *c->p++;
+  *major = initial >> 5;
+  *info = initial & 0x1F;
+
+  size_t n;
+  if (*info < 24) {
+    *arg = *info;
+    return 0;
+  } else if (*info == 24) {
+    n = 1;
+  } else if (*info == 25) {
+    n = 2;
+  } else if (*info == 26) {
+    n = 4;
+  } else if (*info == 27) {
+    n = 8;
+  } else if (*info == CBOR_INDEFINITE && *major >= CBOR_BYTES &&
+             *major <= CBOR_MAP) {
+    *arg = 0;
+    return 0;
+  } else {
+    return 1;
+  }
+
+  if ((size_t)(c->end - c->p) < n) return 1;
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; i++) v = (v << 8) | *c->p++;  // Big endian
+  *arg = v;
+  return 0;
+}
+
+static bool at_break(struct cursor *c) {
+  if (c->p < c->end && *c->p == CBOR_BREAK) {
+    c->p++;
+    return true;
+  }
+  return false;
+}
+
+static int skip_item(struct cursor *c, int depth) {
+  if (depth > CBOR_NESTING_MAX) return 1;
+
+  uint8_t major, info;
+  uint64_t arg;
+  if (read_head(c, &major, &info, &arg) != 0) return 1;
+
+  switch (major) {
+    case CBOR_UINT:
+    case CBOR_NEGINT:
+    case CBOR_SIMPLE:
+      return 0;
+    case CBOR_BYTES:
+    case CBOR_TEXT:
+      if (info == CBOR_INDEFINITE) {
+        // A run of definite chunks closed by a break
+        while (!at_break(c)) {
+          if (skip_item(c, depth + 1) != 0) return 1;
+        }
+        return 0;
+      }
+      if ((uint64_t)(c->end - c->p) < arg) return 1;
+      c->p += arg;
+      return 0;
+    case CBOR_ARRAY:
+    case CBOR_MAP: {
+      int per_entry = major == CBOR_MAP ? 2 : 1;
+      if (info == CBOR_INDEFINITE) {
+        while (!at_break(c)) {
+          for (int i = 0; i < per_entry; i++) {
+            if (skip_item(c, depth + 1) != 0) return 1;
+          }
+        }
+        return 0;
+      }
+      for (uint64_t n = 0; n < arg; n++) {
+        for (int i = 0; i < per_entry; i++) {
+          if (skip_item(c, depth + 1) != 0) return 1;
+        }
+      }
+      return 0;
+    }
+    case CBOR_TAG:
+      return skip_item(c, depth + 1);
+  }
+  return 1;
+}
+
+static double half_to_double(uint16_t half) {
+  int exponent = (half >> 10) & 0x1F;
+  int mantissa = half & 0x3FF;
+  double value;
+  if (exponent == 0) {
+    value = ldexp(mantissa, -24);
+  } else if (exponent != 31) {
+    value = ldexp(mantissa + 1024, exponent - 25);
+  } else {
+    value = mantissa == 0 ? INFINITY : NAN;
+  }
+  return half & 0x8000 ? -value : value;
+}
+
+static void set_number(flatjson_value_t *value, double number) {
+  value->type = FLATJSON_NUMBER;
+  value->number = number;
+  if (isnan(number)) {
+    value->integer = 0;
+  } else if (number >= INT_MAX) {
+    value->integer = INT_MAX;
+  } else if (number <= INT_MIN) {
+    value->integer = INT_MIN;
+  } else {
+    value->integer = (int)number;
+  }
+}
+
+// Copies a definite-length text string into out. Returns 1 if malformed,
+// -1 if it was skipped for not fitting.
+static int read_text(struct cursor *c, uint64_t len, char *out, size_t cap) {
+  if ((uint64_t)(c->end - c->p) < len) return 1;
+  if (len >= cap) {
+    c->p += len;
+    return -1;
+  }
+  memcpy(out, c->p, len);
+  out[len] = '\0';
+  c->p += len;
+  return 0;
+}
+
+// Reads one map value. Returns 1 if malformed, -1 if it should not be
+// reported.
+static int read_value(struct cursor *c, flatjson_value_t *value, char *string,
+                      size_t string_cap) {
+  const uint8_t *start = c->p;
+  uint8_t major, info;
+  uint64_t arg;
+  if (read_head(c, &major, &info, &arg) != 0) return 1;
+
+  switch (major) {
+    case CBOR_UINT:
+      set_number(value, (double)arg);
+      return 0;
+    case CBOR_NEGINT:
+      set_number(value, -1.0 - (double)arg);
+      return 0;
+    case CBOR_TEXT:
+      if (info != CBOR_INDEFINITE) {
+        int status = read_text(c, arg, string, string_cap);
+        if (status != 0) return status;
+        value->type = FLATJSON_STRING;
+        value->string = string;
+        value->string_len = arg;
+        return 0;
+      }
+      break;  // Chunked text is skipped like a nested item
+    case CBOR_SIMPLE:
+      if (info == 20 || info == 21) {
+        value->type = FLATJSON_BOOL;
+        value->boolean = info == 21;
+        return 0;
+      } else if (info == 22 || info == 23) {
+        value->type = FLATJSON_NULL;
+        return 0;
+      } else if (info == 25) {
+        set_number(value, half_to_double(arg));
+        return 0;
+      } else if (info == 26) {
+        uint32_t bits = arg;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        set_number(value, f);
+        return 0;
+      } else if (info == 27) {
+        double d;
+        memcpy(&d, &arg, sizeof(d));
+        set_number(value, d);
+        return 0;
+      }
+      value->type = FLATJSON_NESTED;
+      return 0;
+  }
+
+  // Byte strings, arrays, maps and tagged items
+  c->p = start;
+  if (skip_item(c, 0) != 0) return 1;
+  value->type = FLATJSON_NESTED;
+  return 0;
+}
+
+int wsframe_parse_control(const uint8_t *buf, size_t len, flatjson_cb_t cb,
+                          void *ctx) {
+  struct cursor c = {.p = buf, .end = buf + len};
+  char key[FLATJSON_KEY_MAX];
+  char string[FLATJSON_STRING_MAX];
+
+  uint8_t major, info;
+  uint64_t count;
+  if (read_head(&c, &major, &info, &count) != 0 || major != CBOR_MAP) {
+    return 1;
+  }
+  bool indefinite = info == CBOR_INDEFINITE;
+
+  for (uint64_t i = 0; indefinite || i < count; i++) {
+    if (indefinite && at_break(&c)) break;
+
+    uint8_t key_major, key_info;
+    uint64_t key_len;
+    if (read_head(&c, &key_major, &key_info, &key_len) != 0 ||
+        key_major != CBOR_TEXT || key_info == CBOR_INDEFINITE) {
+      return 1;
+    }
+    int key_status = read_text(&c, key_len, key, sizeof(key));
+    if (key_status > 0) return 1;
+
+    flatjson_value_t value = {0};
+    int value_status = read_value(&c, &value, string, sizeof(string));
+    if (value_status > 0) return 1;
+
+    if (key_status == 0 && value_status == 0) cb(key, &value, ctx);
+  }
+  return c.p == c.end ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "flatjson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * WebSocket protocol v2: every binary message starts with a header that
+ * carries the options for its payload, so an image and its metadata arrive
+ * atomically. All integers are little endian.
+ *
+ *   uint8  version (2)
+ *   uint8  type (WSFRAME_TYPE_*)
+ *   uint8  flags (WSFRAME_FLAG_*)
+ *   uint8  zone (0 = main image queue)
+ *   uint16 dwell_secs (0 = device default)
+ *   uint16 ttl_secs (0 = no expiry)
+ *   uint32 seq
+ *   uint32 crc32 of the payload
+ *   char   app_id[16] (NUL padded)
+ *   uint64 timestamp_ms (Unix time, only with WSFRAME_FLAG_TIMESTAMP)
+ *
+ * followed by the payload: a WebP image or bundle, or a CBOR map with the
+ * same keys as a JSON control message. The device sends telemetry the same
+ * way, with only the type, seq and crc fields set.
+ */
+#define WSFRAME_VERSION 2
+#define WSFRAME_HEADER_LEN 32
+#define WSFRAME_TIMESTAMP_LEN 8
+#define WSFRAME_APP_ID_LEN 16
+
+#define WSFRAME_TYPE_IMAGE 1
+#define WSFRAME_TYPE_CONTROL 2
+#define WSFRAME_TYPE_TELEMETRY 3  // Device to server: CBOR telemetry report
+
+#define WSFRAME_FLAG_IMMEDIATE 0x01   // Interrupt whatever is showing
+#define WSFRAME_FLAG_BACKGROUND 0x02  // Only play when nothing else waits
+#define WSFRAME_FLAG_TIMESTAMP 0x04   // timestamp_ms follows the header
+
+typedef struct {
+  uint8_t type;
+  uint8_t flags;
+  uint8_t zone;
+  uint16_t dwell_secs;
+  uint16_t ttl_secs;
+  uint32_t seq;
+  uint32_t crc;
+  char app_id[WSFRAME_APP_ID_LEN + 1];
+  uint64_t timestamp_ms;  // 0 if not sent
+  size_t header_len;      // Bytes before the payload
+} wsframe_header_t;
+
+/**
+ * @brief Decode the header at the start of a v2 binary message
+ *
+ * @param buf First bytes of the message; must hold the whole header
+ * @return int 0 on success, 1 if buf doesn't start with a valid header
+ */
+int wsframe_parse_header(const uint8_t *buf, size_t len,
+                         wsframe_header_t *header);
+
+/**
+ * @brief Write a header for a device-to-server message
+ *
+ * @param out Receives WSFRAME_HEADER_LEN bytes
+ */
+void wsframe_write_header(uint8_t *out, uint8_t type, uint32_t seq,
+                          const uint8_t *payload, size_t len);
+
+/**
+ * @brief Walk a CBOR map of control settings
+ *
+ * Understands text string keys with integer, float, text string, boolean
+ * and null values; arrays, maps and other values are reported as
+ * FLATJSON_NESTED. Values are reported like flatjson_parse() does, so the
+ * same handlers serve both encodings.
+ *
+ * @return int 0 on success, 1 if buf is not a well-formed map
+ */
+int wsframe_parse_control(const uint8_t *buf, size_t len, flatjson_cb_t cb,
+                          void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,125 @@
+#include "wsout.h"
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "wsout";
+
+#define WSOUT_SLOTS 8
+// A stalled connection holds up only this task, and only this long
+#define WSOUT_SEND_TIMEOUT_MS 5000
+
+struct wsout_msg {
+  wsout_kind_t kind;
+  size_t len;
+  char text[WSOUT_MSG_MAX];
+};
+
+static esp_websocket_client_handle_t _client;
+static TaskHandle_t _task;
+static struct wsout_msg _ring[WSOUT_SLOTS];
+static int _head;  // Oldest message
+static int _count;
+static wsout_stats_t _stats;
+static portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Takes the oldest message into msg. Returns false if the queue is empty.
+static bool pop(struct wsout_msg *msg) {
+  bool popped = false;
+  portENTER_CRITICAL(&_lock);
+  if (_count > 0) {
+    *msg = _ring[_head];
+    _head = (_head + 1) % WSOUT_SLOTS;
+    _count--;
+    popped = true;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return popped;
+}
+
+// Removes the i-th pending message, moving the newer ones up. Called with
+// _lock held.
+static void remove_at(int i) {
+  for (; i < _count - 1; i++) {
+    _ring[(_head + i) % WSOUT_SLOTS] = _ring[(_head + i + 1) % WSOUT_SLOTS];
+  }
+  _count--;
+}
+
+static void count(uint32_t *counter) {
+  portENTER_CRITICAL(&_lock);
+  (*counter)++;
+  portEXIT_CRITICAL(&_lock);
+}
+
+static void sender_task(void *arg) {
+  static struct wsout_msg msg;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (pop(&msg)) {
+      if (!esp_websocket_client_is_connected(_client)) {
+        count(&_stats.dropped);
+        continue;
+      }
+      int sent = esp_websocket_client_send_text(
+          _client, msg.text, msg.len, pdMS_TO_TICKS(WSOUT_SEND_TIMEOUT_MS));
+      if (sent < 0) {
+        ESP_LOGE(TAG, "Failed to send: %.*s", (int)msg.len, msg.text);
+        count(&_stats.failed);
+      } else {
+        ESP_LOGI(TAG, "WS send: %.*s", (int)msg.len, msg.text);
+        count(&_stats.sent);
+      }
+    }
+  }
+}
+
+int wsout_initialize(esp_websocket_client_handle_t client) {
+  _client = client;
+  if (xTaskCreate(sender_task, "wsout", 3072, NULL, 4, &_task) != pdPASS) {
+    ESP_LOGE(TAG, "Could not create sender task");
+    _task = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+int wsout_send(const char *text, size_t len, wsout_kind_t kind) {
+  if (_task == NULL || len > WSOUT_MSG_MAX) return 1;
+
+  portENTER_CRITICAL(&_lock);
+  if (kind == WSOUT_KIND_DISPLAYING) {
+    // The replacement goes to the back rather than into the old slot, so it
+    // can't overtake "queued" messages sent after that one, whose occupancy
+    // and credits would then be older than its own
+    for (int i = 0; i < _count; i++) {
+      if (_ring[(_head + i) % WSOUT_SLOTS].kind != kind) continue;
+      remove_at(i);
+      _stats.coalesced++;
+      break;
+    }
+  }
+  if (_count == WSOUT_SLOTS) {
+    _head = (_head + 1) % WSOUT_SLOTS;
+    _count--;
+    _stats.dropped++;
+  }
+  struct wsout_msg *slot = &_ring[(_head + _count) % WSOUT_SLOTS];
+  _count++;
+  slot->kind = kind;
+  slot->len = len;
+  memcpy(slot->text, text, len);
+  portEXIT_CRITICAL(&_lock);
+
+  xTaskNotifyGive(_task);
+  return 0;
+}
+
+void wsout_get_stats(wsout_stats_t *stats) {
+  portENTER_CRITICAL(&_lock);
+  *stats = _stats;
+  portEXIT_CRITICAL(&_lock);
+}
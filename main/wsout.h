@@ -0,0 +1,53 @@
+#pragma once
+
+#include <esp_websocket_client.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest message that can be queued
+#define WSOUT_MSG_MAX 160
+
+typedef enum {
+  WSOUT_KIND_QUEUED,
+  // Only the newest is worth sending: a pending one is dropped and the new
+  // one queued at the back
+  WSOUT_KIND_DISPLAYING,
+  WSOUT_KIND_OTHER,
+} wsout_kind_t;
+
+typedef struct {
+  uint32_t sent;
+  uint32_t coalesced;  // Replaced by a newer message before being sent
+  uint32_t dropped;    // Pushed out of a full queue or sent while offline
+  uint32_t failed;     // Send error or timeout
+} wsout_stats_t;
+
+/**
+ * @brief Start the sender task for outbound WebSocket text messages
+ *
+ * @return int 0 on success
+ */
+int wsout_initialize(esp_websocket_client_handle_t client);
+
+/**
+ * @brief Queue a text message without blocking
+ *
+ * The message is copied. When the queue is full the oldest message is
+ * dropped, since newer state supersedes it. Safe to call from any task.
+ *
+ * @return int 0 if queued, 1 if it was too long or the sender isn't running
+ */
+int wsout_send(const char *text, size_t len, wsout_kind_t kind);
+
+/**
+ * @brief Get the counters since start
+ */
+void wsout_get_stats(wsout_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
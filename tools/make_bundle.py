@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Pack WebP files into a bundle the firmware unpacks into its rotation.
+
+Each image is given as path[:app_id[:dwell_secs[:brightness]]], e.g.:
+
+    python3 tools/make_bundle.py out.tbb clock.webp:clock:10 weather.webp:wx:15:40
+
+Serve the result as the HTTP response body, or send it as a WebSocket,
+SSE-announced or MQTT image. See main/bundle.h for the layout.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"TBB1"
+MAX_ENTRIES = 16
+APP_ID_LEN = 16
+BRIGHTNESS_UNCHANGED = 0xFF
+FLAG_IMMEDIATE = 0x01
+FLAG_BACKGROUND = 0x02
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument("output_file", help="Bundle file to write")
+parser.add_argument("images", nargs="+", help="path[:app_id[:dwell[:brightness]]]")
+parser.add_argument(
+    "--immediate", action="store_true", help="Interrupt what is showing"
+)
+args = parser.parse_args()
+
+if len(args.images) > MAX_ENTRIES:
+    sys.exit(f"At most {MAX_ENTRIES} images fit in a bundle")
+
+bundle = bytearray(MAGIC + struct.pack("<B3x", len(args.images)))
+for i, spec in enumerate(args.images):
+    path, *fields = spec.split(":")
+    app_id = fields[0] if len(fields) > 0 else ""
+    dwell = int(fields[1]) if len(fields) > 1 else 0
+    brightness = int(fields[2]) if len(fields) > 2 else BRIGHTNESS_UNCHANGED
+    flags = FLAG_IMMEDIATE if args.immediate and i == 0 else 0
+
+    with open(path, "rb") as f:
+        webp = f.read()
+    app_id_bytes = app_id.encode()[:APP_ID_LEN].ljust(APP_ID_LEN, b"\0")
+    bundle += struct.pack("<IHBB", len(webp), dwell, brightness, flags)
+    bundle += app_id_bytes + webp
+
+with open(args.output_file, "wb") as f:
+    f.write(bundle)
+print(f"Wrote {len(args.images)} image(s), {len(bundle)} bytes to {args.output_file}")
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Pack changed regions into a delta the firmware draws over the image on screen.
+
+The base is the file that produced what the device shows: the WebP it was
+sent, or the previous delta when chaining. Each region is a static WebP given
+as path@x,y, e.g.:
+
+    python3 tools/make_delta.py out.tbd clock.webp minutes.webp@40,12
+
+Send the result wherever an image goes. If the base is not on screen the
+device ignores the delta and, over WebSocket, replies with "delta_miss". See
+main/delta.h for the layout.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"TBD1"
+MAX_REGIONS = 32
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument("output_file", help="Delta file to write")
+parser.add_argument("base", help="Image or delta the regions apply to")
+parser.add_argument("regions", nargs="+", help="path@x,y")
+args = parser.parse_args()
+
+if len(args.regions) > MAX_REGIONS:
+    sys.exit(f"At most {MAX_REGIONS} regions fit in a delta")
+
+with open(args.base, "rb") as f:
+    base_hash = zlib.crc32(f.read())
+
+delta = bytearray(MAGIC + struct.pack("<IB3x", base_hash, len(args.regions)))
+for spec in args.regions:
+    path, _, position = spec.rpartition("@")
+    if not path:
+        sys.exit(f"Region {spec} needs a position: path@x,y")
+    x, y = (int(v) for v in position.split(","))
+    with open(path, "rb") as f:
+        webp = f.read()
+    delta += struct.pack("<HHI", x, y, len(webp)) + webp
+
+with open(args.output_file, "wb") as f:
+    f.write(delta)
+print(
+    f"Wrote {len(args.regions)} region(s), {len(delta)} bytes to "
+    f"{args.output_file} (hash {zlib.crc32(delta):08x})"
+)
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Publish an image or control message to devices on the MQTT transport.
+
+Handy for trying the transport against a local broker, e.g.:
+
+    mosquitto -v
+    mosquitto_sub -v -t 'tronbyt/#'  # watch what reaches the broker
+    # flash a device with image URL mqtt://<host>/tronbyt?groups=lobby
+    python3 tools/mqtt_publish.py --group lobby --image tools/output.webp
+    python3 tools/mqtt_publish.py --device a1b2c3d4e5f6 --control '{"brightness": 40}'
+
+Messages are retained unless --no-retain is given, so devices that connect
+later get them too. The broker replays a retained message on every connect;
+devices ignore reboot and ota_url in retained control messages, so send those
+with --no-retain. --clear removes the retained image or control message of
+a device or group.
+
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+
+import argparse
+import json
+import sys
+
+import paho.mqtt.publish as publish
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument("--host", default="localhost", help="Broker host")
+parser.add_argument("--port", type=int, default=1883, help="Broker port")
+parser.add_argument("--base", default="tronbyt", help="Base topic")
+target = parser.add_mutually_exclusive_group(required=True)
+target.add_argument("--device", help="Device MAC as 12 hex digits")
+target.add_argument("--group", help="Group name")
+payload = parser.add_mutually_exclusive_group(required=True)
+payload.add_argument("--image", help="WebP file to publish")
+payload.add_argument("--control", help="JSON control message to publish")
+payload.add_argument(
+    "--clear",
+    choices=["image", "control"],
+    help="Remove the retained message on this topic",
+)
+parser.add_argument(
+    "--no-retain",
+    action="store_true",
+    help="Don't retain the message for devices that connect later",
+)
+args = parser.parse_args()
+
+if args.device:
+    prefix = f"{args.base}/{args.device.lower().replace(':', '')}"
+else:
+    prefix = f"{args.base}/group/{args.group}"
+
+if args.clear:
+    # An empty retained message deletes the stored one
+    topic = f"{prefix}/{args.clear}"
+    data = b""
+    args.no_retain = False
+elif args.image:
+    topic = f"{prefix}/image"
+    with open(args.image, "rb") as f:
+        data: bytes | str = f.read()
+else:
+    topic = f"{prefix}/control"
+    try:
+        message = json.loads(args.control)
+    except ValueError as e:
+        sys.exit(f"Control message is not valid JSON: {e}")
+    keys = set(message) if isinstance(message, dict) else set()
+    one_shot = {"reboot", "ota_url"} & keys
+    if one_shot and not args.no_retain:
+        sys.exit(f"Devices ignore {', '.join(sorted(one_shot))} in retained "
+                 "messages; publish it with --no-retain")
+    data = args.control
+
+publish.single(
+    topic,
+    payload=data,
+    qos=1,
+    retain=not args.no_retain,
+    hostname=args.host,
+    port=args.port,
+)
+print(f"Published {len(data)} bytes to {topic}")